@@ -13,8 +13,32 @@ if %errorlevel% NEQ 0 goto exit
 echo Compiling Console_io.cpp 
 "C:\SourceryLite\bin\arm-none-eabi-g++" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\Console_io.o" -c "C:\Users\mmb\dev\mrv32\Console_io.cpp"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
 if %errorlevel% NEQ 0 goto exit
-echo Compiling fifo.c
-"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\fifo.o" -c "C:\Users\mmb\dev\mrv32\fifo.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
+echo Compiling perf.c
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\perf.o" -c "C:\Users\mmb\dev\mrv32\perf.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
+if %errorlevel% NEQ 0 goto exit
+echo Compiling vblk.c
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\vblk.o" -c "C:\Users\mmb\dev\mrv32\vblk.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
+if %errorlevel% NEQ 0 goto exit
+echo Compiling mmio.c
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\mmio.o" -c "C:\Users\mmb\dev\mrv32\mmio.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
+if %errorlevel% NEQ 0 goto exit
+echo Compiling snap.c
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\snap.o" -c "C:\Users\mmb\dev\mrv32\snap.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
+if %errorlevel% NEQ 0 goto exit
+echo Compiling pvcon.c
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\pvcon.o" -c "C:\Users\mmb\dev\mrv32\pvcon.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
+if %errorlevel% NEQ 0 goto exit
+echo Compiling plic.c
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\plic.o" -c "C:\Users\mmb\dev\mrv32\plic.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
+if %errorlevel% NEQ 0 goto exit
+echo Compiling uart.c
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\uart.o" -c "C:\Users\mmb\dev\mrv32\uart.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
+if %errorlevel% NEQ 0 goto exit
+echo Compiling jit.c
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\jit.o" -c "C:\Users\mmb\dev\mrv32\jit.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
+if %errorlevel% NEQ 0 goto exit
+echo Compiling vram.c
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\vram.o" -c "C:\Users\mmb\dev\mrv32\vram.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
 if %errorlevel% NEQ 0 goto exit
 echo Compiling main.c 
 "C:\SourceryLite\bin\arm-none-eabi-gcc" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -std=c99 -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\main.o" -c "C:\Users\mmb\dev\mrv32\main.c"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
@@ -23,7 +47,7 @@ echo Compiling T2Input.cpp
 "C:\SourceryLite\bin\arm-none-eabi-g++" -static -c -fpic -mcpu=arm7tdmi-s -fvisibility=hidden -mthumb -mlittle-endian -Ofast -D__MRE_COMPILER_GCC__ -fno-exceptions -fno-non-call-exceptions -fno-rtti -fcheck-new -fno-rtti -fcheck-new -fno-rtti -fcheck-new -o "C:\Users\mmb\dev\mrv32\arm\T2Input.o" -c "C:\Users\mmb\dev\mrv32\T2Input.cpp"      -D _MINIGUI_LIB_ -D _USE_MINIGUIENTRY -D _NOUNIX_ -D _FOR_WNC -D __MRE_SDK__ -D   __MRE_VENUS_NORMAL__  -D  __MMI_MAINLCD_240X320__ -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\MRE_SDK\include" -I "C:\MRE_SDK\include\service" -I "C:\Users\mmb\dev\mrv32\include" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\ResID" -I "C:\Users\mmb\dev\mrv32\src\app\widget" -I "C:\Users\mmb\dev\mrv32\src\app\launcher" -I "C:\Users\mmb\dev\mrv32\src\app\wallpaper" -I "C:\Users\mmb\dev\mrv32\src\app\screen_lock" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\include\component" -I "C:\Users\mmb\dev\mrv32\include\service" -I "C:\Users\mmb\dev\mrv32\src\framework" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\base" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\mvc" -I "C:\Users\mmb\dev\mrv32\src\framework\ui_core\pme" -I "C:\Users\mmb\dev\mrv32\src\framework\mmi_core" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\vrt\interface" -I "C:\Users\mmb\dev\mrv32\src\component" -I "C:\Users\mmb\dev\mrv32\src\ui_engine\framework\xml" -I "C:\Users\mmb\dev\mrv32"
 if %errorlevel% NEQ 0 goto exit
 echo Linking app 
-"C:\SourceryLite\bin\arm-none-eabi-gcc" -s -o "C:\Users\mmb\dev\mrv32\mrv32.axf"  "C:\Users\mmb\dev\mrv32\arm\gccmain.o"  "C:\Users\mmb\dev\mrv32\arm\Console.o"  "C:\Users\mmb\dev\mrv32\arm\Console_io.o"  "C:\Users\mmb\dev\mrv32\arm\fifo.o"  "C:\Users\mmb\dev\mrv32\arm\main.o"  "C:\Users\mmb\dev\mrv32\arm\T2Input.o" -Ofast -static -fpic -pie -T "C:\MRE_SDK\lib\MRE30\armgcc_t\scat.ld" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\percommon.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\pertcp.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\persensor.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\persmsper.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\perbitstream.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\percontact.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\permms.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\persmsmng.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\perfile.a"
+"C:\SourceryLite\bin\arm-none-eabi-gcc" -s -o "C:\Users\mmb\dev\mrv32\mrv32.axf"  "C:\Users\mmb\dev\mrv32\arm\gccmain.o"  "C:\Users\mmb\dev\mrv32\arm\Console.o"  "C:\Users\mmb\dev\mrv32\arm\Console_io.o"  "C:\Users\mmb\dev\mrv32\arm\main.o"  "C:\Users\mmb\dev\mrv32\arm\T2Input.o"  "C:\Users\mmb\dev\mrv32\arm\vram.o"  "C:\Users\mmb\dev\mrv32\arm\jit.o"  "C:\Users\mmb\dev\mrv32\arm\uart.o"  "C:\Users\mmb\dev\mrv32\arm\plic.o"  "C:\Users\mmb\dev\mrv32\arm\pvcon.o"  "C:\Users\mmb\dev\mrv32\arm\snap.o"  "C:\Users\mmb\dev\mrv32\arm\mmio.o" -Ofast -static -fpic -pie -T "C:\MRE_SDK\lib\MRE30\armgcc_t\scat.ld" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\percommon.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\pertcp.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\persensor.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\persmsper.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\perbitstream.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\percontact.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\permms.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\persmsmng.a" -l:"C:\MRE_SDK\lib\MRE30\armgcc_t\perfile.a"
 if %errorlevel% NEQ 0 goto exit
 echo Packing resource to app 
 "C:\MRE_SDK\tools\ResEditor\CmdShell.exe" pack -silent -resolution 240x320 -o "C:\Users\mmb\dev\mrv32\mrv32.pkd" -e AXF "C:\Users\mmb\dev\mrv32\mrv32.vcproj" "C:\Users\mmb\dev\mrv32\mrv32.axf"
@@ -134,12 +134,11 @@ void Console::erase_display(int t){
 				erase_line(2,i);
 			break;
 		case 3:
-			for(int i=0;i<=count_of_lines;++i)
-				for(int j=0;j<=terminal_h;++j)
-					history_text[i][j].reset();
+			history_count=history_fwd=0; // Rows are cleared as they are reused by history_push
 		case 2:
 			for(int i=0;i<terminal_h;++i)
 				erase_line(2,i);
+			mark_all_dirty();
 			break;
 	}
 }
@@ -241,16 +240,9 @@ void Console::analise_CSI(char c){
 					for(int i=cursor_x+1;i<terminal_w-p;++i){
 						main_text[cursor_y][i]=main_text[cursor_y][i+p];
 					}
-					for(int j=(cursor_x+1)*char_width; j<(terminal_w-p)*char_width; ++j)
-						for(int i=0; i<char_height; ++i)
-							((unsigned short*)scr_buf)[(i+cursor_y*char_height)*scr_w+j]=
-								((unsigned short*)scr_buf)[(i+cursor_y*char_height)*scr_w+j+p*char_width];
-
 					for(int i=terminal_w-p;i<terminal_w;++i)
 						main_text[cursor_y][i].reset();
-					for(int j=(terminal_w-p)*char_width; j<(terminal_w)*char_width; ++j)
-						for(int i=0; i<char_height; ++i)
-							((unsigned short*)scr_buf)[(i+cursor_y*char_height)*scr_w+j]=0;
+					mark_dirty_row(cursor_y, cursor_x+1, terminal_w-1);
 					status=MAIN;
 				}
 				break;
@@ -271,7 +263,7 @@ void Console::analise_CSI(char c){
 				break;
 
 			case 'r':
-				if(narg == 2 && get_n_param(0,1) < get_n_param(1,1)){
+				if(narg == 2 && get_n_param(0,1) < get_n_param(1,1) && get_n_param(1,1) <= terminal_h){
 					scroll_start_row=get_n_param(0,1)-1;
 					scroll_end_row=get_n_param(1,1);
 				}
@@ -295,18 +287,14 @@ void  Console::erase_line(int t, int y){
 	int end=(t==1?cursor_x:terminal_w-1);
 	for(int i=st;i<=end;++i)
 		main_text[y][i].reset();
-	for(int j=st*char_width; j<(end+1)*char_width; ++j)
-		for(int i=0; i<char_height; ++i)
-			((unsigned short*)scr_buf)[(i+y*char_height)*scr_w+j]=0x0000;
+	mark_dirty_row(y, st, end);
 }
 void  Console::erase_line(int t){
 	int st=(t==0?cursor_x:0);
 	int end=(t==1?cursor_x:terminal_w-1);
 	for(int i=st;i<=end;++i)
 		main_text[cursor_y][i].reset();
-	for(int j=st*char_width; j<(end+1)*char_width; ++j)
-		for(int i=0; i<char_height; ++i)
-			((unsigned short*)scr_buf)[(i+cursor_y*char_height)*scr_w+j]=0x0000;
+	mark_dirty_row(cursor_y, st, end);
 }
 
 void Console::analise_escape_hash(char c){
@@ -396,6 +384,7 @@ void Console::put_char(char c){//todo UTF-8
 			break;
 		case 0x08:
 			main_text[cursor_y][cursor_x].reset();
+			mark_dirty(cursor_x, cursor_y);
 			previos_p();
 			break;
 		case 0x09:
@@ -421,9 +410,13 @@ void Console::put_char(char c){//todo UTF-8
 				break;
 			main_text[cursor_y][cursor_x].ch=c;
 			main_text[cursor_y][cursor_x].flgs=flgs;
-			main_text[cursor_y][cursor_x].textcolor=cur_textcolor;
-			main_text[cursor_y][cursor_x].backcolor=cur_backcolor;
-			draw_cur_char();
+			if(colors[cur_textidx]!=cur_textcolor)
+				cur_textidx=color_index(cur_textcolor);
+			if(colors[cur_backidx]!=cur_backcolor)
+				cur_backidx=color_index(cur_backcolor);
+			main_text[cursor_y][cursor_x].textcolor=cur_textidx;
+			main_text[cursor_y][cursor_x].backcolor=cur_backidx;
+			mark_dirty(cursor_x, cursor_y);
 			next_p();
 			
 			break;
@@ -516,6 +509,24 @@ void Console::putstr(const char *str, int len){
 }
 
 
+// Palette entry for color. New true colors are added while there is room, then the nearest entry is used.
+unsigned char Console::color_index(unsigned short color){
+	int best=0, best_d=0x7fffffff;
+	for(int i=0; i<color_count; ++i){
+		if(colors[i]==color)
+			return i;
+		int dr=(colors[i]>>11)-(color>>11), dg=((colors[i]>>5)&63)-((color>>5)&63), db=(colors[i]&31)-(color&31);
+		int d=4*dr*dr+dg*dg+4*db*db; // 565: red and blue steps are twice as coarse
+		if(d<best_d)
+			best=i, best_d=d;
+	}
+	if(color_count<CONSOLE_COLORS){
+		colors[color_count]=color;
+		return color_count++;
+	}
+	return best;
+}
+
 void Console::previos_p(){
 	if(cursor_x>0)
 		cursor_x--;
@@ -537,103 +548,254 @@ void Console::new_line(){
 	}
 }
 
-void Console::scroll(int v){
-	if(scroll_value+v<0)
-		v=-scroll_value;
+// Swap row in as the newest history line, returns the row for the bottom of the scroll region
+Symbol *Console::history_push(Symbol *row){
+	Symbol *ret=history_text[history_head];
+	history_text[history_head]=row;
+	if(++history_head==history_lines)
+		history_head=0;
+	if(history_count<history_lines)
+		history_count++;
+
+	if(history_fwd>0)
+		history_fwd--; // Line pulled back earlier, bring it back as it was
+	else
+		for(int j=0; j<=terminal_w; ++j)
+			ret[j].reset();
+	return ret;
+}
 
-	if(scroll_value+v>=count_of_lines)//todo
-		v=count_of_lines-1-scroll_value;
-	
-	int scroll_height = scroll_end_row - scroll_start_row;
+// Swap row in for the newest history line, returns that line for the top of the scroll region
+Symbol *Console::history_pop(Symbol *row){
+	if(--history_head<0)
+		history_head=history_lines-1;
+	Symbol *ret=history_text[history_head];
+	history_text[history_head]=row;
+	history_count--;
+	history_fwd++;
+	return ret;
+}
 
-	if(v>scroll_height){
-		scroll(v-scroll_height);//todo
-		scroll(v);
+void Console::scroll(int v){
+	int scroll_height = scroll_end_row - scroll_start_row;
+	if(scroll_height<=0)
 		return;
-		//v=scroll_height;
+
+	while(v>0){
+		int n = v<scroll_height ? v : scroll_height;
+		for(int i=0; i<n; ++i)
+			scroll_temp_text[i]=history_push(main_text[scroll_start_row+i]);
+		memmove(main_text+scroll_start_row, main_text+scroll_start_row+n, (scroll_height-n)*sizeof(Symbol*));
+		memcpy(main_text+scroll_end_row-n, scroll_temp_text, n*sizeof(Symbol*));
+		scroll_dirty(n);
+		v-=n;
 	}
-	if(v<-scroll_height){
-		scroll(+scroll_height+v);//todo
-		scroll(v);
+
+	while(v<0){
+		int n = -v<scroll_height ? -v : scroll_height;
+		if(n>history_count)
+			n=history_count;
+		if(n==0)
+			break;
+		for(int i=n-1; i>=0; --i)
+			scroll_temp_text[i]=history_pop(main_text[scroll_end_row-n+i]);
+		memmove(main_text+scroll_start_row+n, main_text+scroll_start_row, (scroll_height-n)*sizeof(Symbol*));
+		memcpy(main_text+scroll_start_row, scroll_temp_text, n*sizeof(Symbol*));
+		scroll_dirty(-n);
+		v+=n;
+	}
+}
+
+// Move the dirty marks with the text and queue the pixels for one memmove in draw_dirty()
+void Console::scroll_dirty(int v){
+	int scroll_height = scroll_end_row - scroll_start_row;
+	int n = v>0 ? v : -v;
+
+	if(dirty_all)
 		return;
-		//v=-scroll_height;
+
+	if(blit_rows && (blit_start!=scroll_start_row || blit_end!=scroll_end_row)){
+		// Scroll region changed, redraw what the pending blit would have moved
+		for(int i=blit_start; i<blit_end; ++i)
+			mark_dirty_row(i, 0, terminal_w-1);
+		blit_rows=0;
 	}
+
+	VMUINT32 *rows=dirty+scroll_start_row*dirty_words;
 	if(v>0){
-		for(int i=0; i<v; ++i){
-			scroll_temp_text[i]=history_text[i+scroll_value];  //1
-			history_text[i+scroll_value]=main_text[i+scroll_start_row]; //2
-		}
-		for(int i=0; i<scroll_height-v; ++i)
-			main_text[i+scroll_start_row]=main_text[scroll_start_row+i+v];//3
-		
-		for(int i=0; i<v; ++i)
-			main_text[i+scroll_end_row-v]=scroll_temp_text[i];//4
-
-		for(int i=scroll_start_row*char_height;i <(scroll_end_row-v)*char_height; ++i) //redraw
-			for(int j=0; j<scr_w; ++j)
-				((unsigned short*)scr_buf)[i*scr_w+j]=((unsigned short*)scr_buf)[(i+v*char_height)*scr_w+j];
-
-		for(int i=0; i<v; ++i)
-			for(int j=0; j<terminal_w; ++j)
-				draw_xy_char(j, i+scroll_end_row-v);
-
-		scroll_value+=v;
-
-	}else if(v<0){
-		v=-v;
-		for(int i=0; i<v; ++i){
-			scroll_temp_text[i]=history_text[i-v+scroll_value];  //1
-			history_text[i-v+scroll_value]=main_text[i+scroll_end_row-v]; //2
-		}
-		for(int i=0; i<scroll_height-v; ++i)
-			main_text[scroll_end_row-i-1]=main_text[scroll_end_row-i-1-v];//3
-		
-		for(int i=0; i<v; ++i)
-			main_text[i+scroll_start_row]=scroll_temp_text[i];//4
-
-		for(int i=(scroll_end_row)*char_height-1; i>=(scroll_start_row+v)*char_height; --i) //redraw
-			for(int j=0; j<scr_w; ++j)
-				((unsigned short*)scr_buf)[i*scr_w+j]=((unsigned short*)scr_buf)[(i-v*char_height)*scr_w+j];
-
-		for(int i=0; i<v; ++i)
-			for(int j=0; j<terminal_w; ++j)
-				draw_xy_char(j, i);
-
-		scroll_value-=v;
-		//todo
+		memmove(rows, rows+n*dirty_words, (scroll_height-n)*dirty_words*sizeof(VMUINT32));
+		for(int i=scroll_end_row-n; i<scroll_end_row; ++i)
+			mark_dirty_row(i, 0, terminal_w-1);
+	}else{
+		memmove(rows+n*dirty_words, rows, (scroll_height-n)*dirty_words*sizeof(VMUINT32));
+		for(int i=scroll_start_row; i<scroll_start_row+n; ++i)
+			mark_dirty_row(i, 0, terminal_w-1);
+	}
+
+	blit_start=scroll_start_row;
+	blit_end=scroll_end_row;
+	blit_rows+=v;
+	if(blit_rows>=scroll_height || blit_rows<=-scroll_height){
+		// Nothing left to move, every row gets redrawn anyway
+		for(int i=scroll_start_row; i<scroll_end_row; ++i)
+			mark_dirty_row(i, 0, terminal_w-1);
+		blit_rows=0;
 	}
+}
 
+static void expand_glyph(unsigned short *dst, int pitch, int rows, unsigned char ch, unsigned short textcolor, unsigned short backcolor){
+	const unsigned char *font_ch=ProFont6x11+5 + 12*ch + 1;
+	for(int i=0;i<rows;++i){
+		for(int j=0;j<char_width;++j)
+			dst[j]=((((*font_ch)>>j)&1)?textcolor:backcolor);
+		dst+=pitch;
+		++font_ch;
+	}
+}
+
+// Find or build the tile for ch in these colors. Sets are GLYPH_CACHE_WAYS tiles, evicted round robin.
+const VMUINT32 *Console::glyph_tile(unsigned char ch, unsigned short textcolor, unsigned short backcolor){
+	VMUINT32 colors=((VMUINT32)textcolor<<16)|backcolor;
+	int set=(ch ^ (textcolor*7) ^ (backcolor*31) ^ (backcolor>>8)) & (GLYPH_CACHE_TILES/GLYPH_CACHE_WAYS-1);
+	int first=set*GLYPH_CACHE_WAYS;
+
+	for(int i=first; i<first+GLYPH_CACHE_WAYS; ++i)
+		if(glyph_chars[i]==ch && glyph_colors[i]==colors)
+			return glyph_tiles + i*char_height*glyph_words;
+
+	int i=first+glyph_next[set];
+	glyph_next[set]=(glyph_next[set]+1)&(GLYPH_CACHE_WAYS-1);
+	glyph_chars[i]=ch;
+	glyph_colors[i]=colors;
+	VMUINT32 *tile=glyph_tiles + i*char_height*glyph_words;
+	expand_glyph((unsigned short*)tile, char_width, char_height, ch, textcolor, backcolor);
+	return tile;
 }
 
 void Console::draw_xy_char(int x, int y){
-	const unsigned char *font_ch=ProFont6x11+5 + 12*main_text[y][x].ch + 1;
-	unsigned short textcolor = main_text[y][x].textcolor , backcolor = main_text[y][x].backcolor; 
+	unsigned char ch = main_text[y][x].ch;
+	unsigned short textcolor = colors[main_text[y][x].textcolor] , backcolor = colors[main_text[y][x].backcolor]; 
 	if(main_text[y][x].flgs&1)
 		textcolor=~textcolor, backcolor=~backcolor;
 
-	for(int i=0;i<char_height;++i){
-		unsigned short* scr_buf= (unsigned short*)this->scr_buf + x*char_width+(y*char_height+i)*scr_w;
-		for(int j=0;j<char_width;++j)
-				scr_buf[j]=((((*font_ch)>>j)&1)?textcolor:backcolor);
-		++font_ch;
+	int rows = scr_h-y*char_height < char_height ? scr_h-y*char_height : char_height;
+	blit_glyph((unsigned short*)this->scr_buf + x*char_width+y*char_height*scr_w, scr_w, rows, ch, textcolor, backcolor);
+}
+
+// Glyph ch at dst, a buffer pitch pixels wide, from the tile cache
+void Console::blit_glyph(unsigned short *dst, int pitch, int rows, unsigned char ch, unsigned short textcolor, unsigned short backcolor){
+	if(!glyph_tiles){
+		expand_glyph(dst, pitch, rows, ch, textcolor, backcolor);
+		return;
+	}
+
+	const VMUINT32 *tile=glyph_tile(ch, textcolor, backcolor);
+	if(((size_t)dst|pitch*2)&3){ // Rows aren't word aligned, copy pixels
+		const unsigned short *px=(const unsigned short*)tile;
+		for(int i=0;i<rows;++i){
+			for(int j=0;j<char_width;++j)
+				dst[j]=px[j];
+			dst+=pitch;
+			px+=char_width;
+		}
+		return;
+	}
+	VMUINT32 *dst32=(VMUINT32*)dst;
+	for(int i=0;i<rows;++i){
+		dst32[0]=tile[0];
+		dst32[1]=tile[1];
+		dst32[2]=tile[2];
+		dst32+=pitch/2;
+		tile+=glyph_words;
 	}
 }
 
-void Console::draw_cur_char(){
-	const unsigned char *font_ch=ProFont6x11+5 + 12*main_text[cursor_y][cursor_x].ch + 1;
-	unsigned short textcolor = cur_textcolor , backcolor = cur_backcolor; 
-	if(flgs&1)
-		textcolor=~textcolor, backcolor=~backcolor;
+// Only the set pixels of ch, in white, over what dst already has. The white on black
+// tile is its own mask, so that's an OR of the tile.
+void Console::blit_glyph_over(unsigned short *dst, int pitch, int rows, unsigned char ch){
+	if(!glyph_tiles){
+		const unsigned char *font_ch=ProFont6x11+5 + 12*ch + 1;
+		for(int i=0;i<rows;++i){
+			for(int j=0;j<char_width;++j)
+				if(((*font_ch)>>j)&1)
+					dst[j]=0xFFFF;
+			dst+=pitch;
+			++font_ch;
+		}
+		return;
+	}
 
-	for(int i=0;i<char_height;++i){
-		unsigned short* scr_buf= (unsigned short*)this->scr_buf + cursor_x*char_width+(cursor_y*char_height+i)*scr_w;
-		for(int j=0;j<char_width;++j)
-				scr_buf[j]=((((*font_ch)>>j)&1)?cur_textcolor:cur_backcolor);
-		++font_ch;
+	const VMUINT32 *tile=glyph_tile(ch, 0xFFFF, 0);
+	if(((size_t)dst|pitch*2)&3){
+		const unsigned short *px=(const unsigned short*)tile;
+		for(int i=0;i<rows;++i){
+			for(int j=0;j<char_width;++j)
+				dst[j]|=px[j];
+			dst+=pitch;
+			px+=char_width;
+		}
+		return;
+	}
+	VMUINT32 *dst32=(VMUINT32*)dst;
+	for(int i=0;i<rows;++i){
+		dst32[0]|=tile[0];
+		dst32[1]|=tile[1];
+		dst32[2]|=tile[2];
+		dst32+=pitch/2;
+		tile+=glyph_words;
+	}
+}
+
+void Console::mark_dirty(int x, int y){
+	dirty[y*dirty_words+(x>>5)] |= 1u<<(x&31);
+	dirty_any=true;
+}
+
+void Console::mark_dirty_row(int y, int st, int end){
+	if(st<0)
+		st=0;
+	for(int x=st; x<=end; ++x)
+		dirty[y*dirty_words+(x>>5)] |= 1u<<(x&31);
+	dirty_any=true;
+}
+
+void Console::mark_all_dirty(){
+	dirty_all=dirty_any=true;
+}
+
+// Draw the cells changed since the last call, once per frame from draw() in main.c
+bool Console::draw_dirty(){
+	if(!dirty_any || !scr_buf)
+		return false;
+
+	if(dirty_all){
+		draw_all();
+	}else{
+		if(blit_rows){
+			int row=char_height*scr_w; // Pixels per text row
+			unsigned short *buf=(unsigned short*)scr_buf + blit_start*row;
+			int h=blit_end-blit_start;
+			if(blit_rows>0)
+				memmove(buf, buf+blit_rows*row, (h-blit_rows)*row*sizeof(unsigned short));
+			else
+				memmove(buf-blit_rows*row, buf, (h+blit_rows)*row*sizeof(unsigned short));
+			blit_rows=0;
+		}
+		for(int y=0; y<=terminal_h; ++y)
+			for(int k=0; k<dirty_words; ++k){
+				VMUINT32 w=dirty[y*dirty_words+k];
+				for(int x=k*32; w; ++x, w>>=1)
+					if(w&1)
+						draw_xy_char(x, y);
+			}
 	}
+	memset(dirty, 0, (terminal_h+1)*dirty_words*sizeof(VMUINT32));
+	dirty_any=dirty_all=false;
+	return true;
 }
 
 void Console::draw_all(){
+	blit_rows=0;
 	vm_graphic_fill_rect(scr_buf, 0, 0, scr_w, scr_h, main_color, main_color);
 	for (int i = 0; i < terminal_h; ++i)
 		for (int j = 0; j < terminal_w; ++j)
@@ -655,7 +817,8 @@ void Console::init(){
 
 	scroll_start_row = 0;
 	scroll_end_row = terminal_h;
-	scroll_value = 0;
+	history_head = history_count = history_fwd = 0;
+	blit_rows = 0;
 
 	UTF_l=0;
 
@@ -666,33 +829,69 @@ void Console::init(){
 
 	scr_buf = 0;
 
+	for(int i=0; i<8; ++i){
+		colors[i]=maincolors[i];
+		colors[8+i]=brightcolors[i];
+	}
+	color_count=16;
+	cur_textidx=color_index(0xFFFF);
+	cur_backidx=color_index(0x0000);
+
 	reset();
 
+	// History gets what's left of the budget after the screen, so the rest of the heap goes to the RAM cache
+	int row=terminal_w+1;
+	history_lines=CONSOLE_HISTORY_BUDGET/(row*sizeof(Symbol)) - (terminal_h+1);
+	if(history_lines>CONSOLE_HISTORY_MAX)
+		history_lines=CONSOLE_HISTORY_MAX;
+	if(history_lines<1)
+		history_lines=1;
+	while(!(text_block=(Symbol*)vm_malloc((terminal_h+1+history_lines)*row*sizeof(Symbol))) && history_lines>1)
+		history_lines/=2;
+	memset(text_block, 0, (terminal_h+1+history_lines)*row*sizeof(Symbol));
+
 	main_text=(Symbol**)vm_malloc((terminal_h+1)*sizeof(Symbol*));
+	for(int i=0; i<=terminal_h; ++i)
+		main_text[i]=text_block+i*row;
 
-	for(int i=0; i<=terminal_h; ++i){
-		main_text[i]=(Symbol*)vm_malloc((terminal_w+1)*sizeof(Symbol));
-		for(int j=0; j<= terminal_w; ++j)
-			main_text[i][j].reset();
-	}
+	history_text=(Symbol**)vm_malloc(history_lines*sizeof(Symbol*));
+	for(int i=0; i<history_lines; ++i)
+		history_text[i]=text_block+(terminal_h+1+i)*row;
 
 	scroll_temp_text=(Symbol**)vm_malloc((terminal_h+1)*sizeof(Symbol*));
-		
 
-	for(int i=0; i<count_of_lines; ++i){
-		history_text[i]=(Symbol*)vm_malloc((terminal_w+1)*sizeof(Symbol));
-		for(int j=0; j<= terminal_w; ++j)
-			history_text[i][j].reset();
+	dirty_words=(terminal_w+1+31)/32;
+	dirty=(VMUINT32*)vm_calloc((terminal_h+1)*dirty_words*sizeof(VMUINT32));
+	dirty_any=dirty_all=true;
+
+	glyph_tiles=(VMUINT32*)vm_malloc(GLYPH_CACHE_TILES*char_height*glyph_words*sizeof(VMUINT32));
+	glyph_colors=(VMUINT32*)vm_malloc(GLYPH_CACHE_TILES*sizeof(VMUINT32));
+	glyph_chars=(short*)vm_malloc(GLYPH_CACHE_TILES*sizeof(short));
+	if(!glyph_tiles || !glyph_colors || !glyph_chars){ // Draw straight from the font instead
+		if(glyph_tiles)
+			vm_free(glyph_tiles);
+		if(glyph_colors)
+			vm_free(glyph_colors);
+		if(glyph_chars)
+			vm_free(glyph_chars);
+		glyph_tiles=0;
+	}else{
+		for(int i=0; i<GLYPH_CACHE_TILES; ++i)
+			glyph_chars[i]=-1;
+		memset(glyph_next, 0, sizeof(glyph_next));
 	}
 }
 
 Console::~Console(void){
-	for(int i=0;i<terminal_h;++i)
-		vm_free(main_text[i]);
+	vm_free(text_block);
 	vm_free(main_text);
+	vm_free(history_text);
 
 	vm_free(scroll_temp_text);
-	
-	for(int i=0;i<count_of_lines;++i)
-		vm_free(history_text[i]);
+	vm_free(dirty);
+	if(glyph_tiles){
+		vm_free(glyph_tiles);
+		vm_free(glyph_colors);
+		vm_free(glyph_chars);
+	}
 }
@@ -5,19 +5,29 @@
 #include "main.h"
 
 const int char_width = 6, char_height = 11;
-const int count_of_lines = 500;
 
+#ifndef CONSOLE_HISTORY_BUDGET
+#define CONSOLE_HISTORY_BUDGET (48 * 1024) // Heap for scrollback, sets the number of history lines
+#endif
+#define CONSOLE_HISTORY_MAX 500
+#define CONSOLE_COLORS 64                  // Palette entries, the first 16 are the ANSI colors
+
+#ifndef GLYPH_CACHE_TILES
+#define GLYPH_CACHE_TILES 256 // Pre-expanded glyphs kept by Console, 132 bytes each
+#endif
+#define GLYPH_CACHE_WAYS 4
+const int glyph_words = char_width/2; // 32-bit words per tile row
+
+// One cell, colors are indices into Console::colors
 struct Symbol{
 	char ch;
 	unsigned char flgs;
-	unsigned short textcolor, backcolor;
+	unsigned char textcolor, backcolor;
 	Symbol(){
-		(*(short*)&ch)=0;
-		textcolor=backcolor=0;
+		(*(VMUINT32*)&ch)=0;
 	}
 	void reset(){
-		(*(short*)&ch)=0;
-		textcolor=backcolor=0;
+		(*(VMUINT32*)&ch)=0;
 	}
 };
 
@@ -26,7 +36,14 @@ class Console
 public:
 	Symbol **main_text;
 	Symbol **scroll_temp_text;
-	Symbol *history_text[count_of_lines];
+	Symbol *text_block; // Every row of main_text and history_text, they trade rows when scrolling
+
+	// Scrollback ring, the newest line scrolled off the top is at history_head-1
+	Symbol **history_text;
+	int history_lines; // Size of the ring, from CONSOLE_HISTORY_BUDGET
+	int history_head;  // Next slot to push into
+	int history_count; // Lines behind history_head
+	int history_fwd;   // Lines from history_head on, pulled back by scroll(-v) and restored by scroll(v)
 
 	enum Status{
 		MAIN,
@@ -43,7 +60,7 @@ public:
 	int saved_cursor_x, saved_cursor_y;
 	int terminal_w, terminal_h;
 
-	int scroll_start_row, scroll_end_row, scroll_value; 
+	int scroll_start_row, scroll_end_row;
 
 	bool bright;
 
@@ -53,10 +70,29 @@ public:
 
 	unsigned short main_color;
 	unsigned short cur_textcolor, cur_backcolor; 
+	unsigned char cur_textidx, cur_backidx; // Palette entries of cur_textcolor and cur_backcolor
+
+	// Palette for Symbol colors: maincolors, brightcolors, then true colors from SGR 38/48 as they show up
+	unsigned short colors[CONSOLE_COLORS];
+	int color_count;
 	unsigned char flgs;
 
 	VMUINT8* scr_buf;
 
+	// Damage tracking: cells are drawn once per frame by draw_dirty(), not as they change
+	VMUINT32 *dirty;  // Per row bitmap of cells to redraw, dirty_words words per row
+	int dirty_words;
+	bool dirty_any;
+	bool dirty_all;   // Redraw the whole screen, margins included
+	int blit_rows;    // Pending framebuffer scroll of the blit_start..blit_end region, >0 is up
+	int blit_start, blit_end;
+
+	// Glyph cache: cells are copied from RGB565 tiles keyed by character and colors
+	VMUINT32 *glyph_tiles;   // char_height rows of glyph_words words per tile, NULL if it couldn't be allocated
+	VMUINT32 *glyph_colors;  // textcolor<<16 | backcolor of each tile
+	short *glyph_chars;      // Character of each tile, -1 if unused
+	VMUINT8 glyph_next[GLYPH_CACHE_TILES/GLYPH_CACHE_WAYS]; // Next way to evict in each set
+
 	int narg, args[16];
 
 	Status status, last_status;
@@ -89,11 +125,22 @@ public:
 	void next_p();
 	void new_line();
 	void scroll(int v);
+	Symbol *history_push(Symbol *row);
+	Symbol *history_pop(Symbol *row);
+	void scroll_dirty(int v);
+
+	unsigned char color_index(unsigned short color);
 
 	void draw_xy_char(int x, int y);
-	void draw_cur_char();
+	const VMUINT32 *glyph_tile(unsigned char ch, unsigned short textcolor, unsigned short backcolor);
+	void blit_glyph(unsigned short *dst, int pitch, int rows, unsigned char ch, unsigned short textcolor, unsigned short backcolor);
+	void blit_glyph_over(unsigned short *dst, int pitch, int rows, unsigned char ch);
+
+	void mark_dirty(int x, int y);
+	void mark_dirty_row(int y, int st, int end);
+	void mark_all_dirty();
+	bool draw_dirty();
 
-	
 	void draw_all();
 
 	void init();
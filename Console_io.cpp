@@ -1,35 +1,47 @@
 #include "Console_io.h"
-#include "fifo.h"
-
-fifo_t serial_in;
+#include "perf.h"
+ring_t serial_in;
+char serial_in_buf[SERIAL_IN_SIZE];
 
 Console console;
 T2Input t2input;
 
 extern "C" void console_char_in(char ch){
+	PERF_LAT(PERF_LAT_ECHO);
 	console.put_c(ch);
 }
 
 extern "C" void console_str_in(const char* str){
+	PERF_LAT(PERF_LAT_ECHO);
+	PERF_TIME_BEGIN(t);
 	console.putstr(str);
+	PERF_TIME_END(t, perf.ms_console);
 }
 
 extern "C" void console_str_with_length_in(const char* str, int length){
+	PERF_LAT(PERF_LAT_ECHO);
+	PERF_TIME_BEGIN(t);
 	console.putstr(str, length);
+	PERF_TIME_END(t, perf.ms_console);
 }
 
 extern "C" void console_char_out(char ch){
-	fifo_add(serial_in, &ch); // Add to FIFO buffer
+	PERF_LAT_BEGIN();
+	ring_push1(&serial_in, ch); // Dropped if the guest is that far behind
 }
 
 extern "C" void console_str_out(const char* str){
-	for(unsigned int i = 0; i < strlen(str); i++){
-		console_char_out(str[i]);
-	}
+	PERF_LAT_BEGIN();
+	ring_push(&serial_in, str, strlen(str));
 }
 
 extern "C" void console_str_with_length_out(const char* str, int length){
-	console_str_out((char*)str);
+	PERF_LAT_BEGIN();
+	ring_push(&serial_in, str, length);
+}
+
+extern "C" int console_flush(){
+	return console.draw_dirty();
 }
 
 extern "C" void terminal_init(){
@@ -37,22 +49,28 @@ extern "C" void terminal_init(){
 	t2input.init();
 }
 
-extern "C" void t2input_draw(VMUINT8* layerbuf1){
+// Compose the overlay layer, returns 0 if nothing on it would change
+extern "C" int t2input_draw(VMUINT8* layerbuf1){
 	int scr_w = vm_graphic_get_screen_width(); 
 	int scr_h = vm_graphic_get_screen_height();
 
+	if(!t2input.need_draw())
+		return 0;
+
 	vm_graphic_fill_rect(layerbuf1, 0, 0, scr_w, scr_h, tr_color, tr_color);
 	vm_graphic_line(layerbuf1, console.cursor_x*char_width, (console.cursor_y+1)*char_height,
 		(console.cursor_x+1)*char_width, (console.cursor_y+1)*char_height, console.cur_textcolor);
 	t2input.draw();
+	return 1;
 }
 
 extern "C" void set_layer_handler(VMUINT8* layerbuf0, VMUINT8* layerbuf1, VMINT layerhdl){
 	console.scr_buf=layerbuf0;
-	console.draw_all();
+	console.mark_all_dirty(); // Drawn with the next frame
 
 	t2input.scr_buf=layerbuf1;
 	t2input.layer_handle=layerhdl;
+	t2input.changed=true;
 }
 
 extern "C" void t2input_handle_keyevt(int event, int keycode){
@@ -2,6 +2,7 @@
 #include "main.h"
 #include "Console.h"
 #include "T2Input.h"
+#include "ring.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,6 +12,7 @@ extern int scr_w;
 extern int scr_h;
 
 extern int vmstate;
+extern int soc_timebase;
 
 void console_char_in(char ch);
 void console_str_in(const char* str);
@@ -20,13 +22,17 @@ void console_char_out(char ch);
 void console_str_out(const char* str);
 void console_str_with_length_out(const char* str, int length);
 
+int console_flush();
 void terminal_init();
-void t2input_draw(VMUINT8* layerbuf1);
+int t2input_draw(VMUINT8* layerbuf1);
 void set_layer_handler(VMUINT8* layerbuf0, VMUINT8* layerbuf1, VMINT layerhdl);
 void t2input_handle_keyevt(int event, int keycode);
 void t2input_handle_penevt(int event, int x, int y);
 
-extern fifo_t serial_in;
+#define SERIAL_IN_SIZE 4096 // Keyboard to guest ring (bytes, power of two), holds a whole paste
+
+extern ring_t serial_in;
+extern char serial_in_buf[SERIAL_IN_SIZE];
 
 void save_state();
 void load_state();
@@ -2,11 +2,10 @@
 #include "ProFont6x11.h"
 #include "Console.h"
 #include "Console_io.h"
+#include "perf.h"
 
 extern Console console;
 
-extern fifo_t serial_in;
-
 extern int scr_w; 
 extern int scr_h;
 
@@ -66,7 +65,8 @@ const name_and_code ctrl_keyboard[10][10] =
 
 const char * num_keyboard[10] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
 const char * Fnum_keyboard[12] = {"F1", "F2", "F3", "F4", "F5", "F6", "F7", "F8", "F9", "F10", "F11", "F12"};
-const char * set_keyboard[12] = {"F%", "CTRL", "TAB", "PAUSE", "CONT", "LOAD", "SAVE", "MAN", "", "Back", "", ""};
+const char * set_keyboard[12] = {"F%", "CTRL", "TAB", "PAUSE", "CONT", "LOAD", "SAVE", "MAN", "CLOCK", "Back", "PERF", ""};
+const char * perf_keyboard[2] = {"DUMP", "RESET"};
 
 const char * Fnum_codes[12] = {"\033[1P", "\033[1Q", "\033[1R", "\033[1S", "\033[15~", 
 	"\033[17~", "\033[18~", "\033[19~", "\033[20~", "\033[21~", "\033[23~", "\033[24~"};
@@ -218,6 +218,7 @@ void T2Input::show_current_pressed_key(){
 }
 
 void T2Input::handle_penevt(VMINT event, VMINT x, VMINT y){
+	changed=true;
 	switch(event){
 		case VM_PEN_EVENT_DOUBLE_CLICK:
 			break;
@@ -278,6 +279,12 @@ void T2Input::numpad_input(int keycode){ //TODO: remake this
 			send_c(Fnum_codes[keycode-1]);
 			break;
 		case SET_MENU:
+			if (vmstate == -2 && keycode >= 4 && keycode <= 8) {
+				// Pause, continue, load and save all need the core, see handle_sysevt()
+				console_str_in("\nCan't run, not enough memory\n");
+				state = MAIN;
+				break;
+			}
 			switch(keycode){
 				case 1:
 					state=F_NUM;
@@ -318,6 +325,26 @@ void T2Input::numpad_input(int keycode){ //TODO: remake this
 					load_man();
 					state = MAIN;
 					break;
+				case 9:
+					// Switch the guest timer between wall clock and instruction count
+					soc_timebase = !soc_timebase;
+					console_str_in(soc_timebase ? "\nTimebase: wall clock\n" : "\nTimebase: cycles\n");
+					state = MAIN;
+					break;
+				case 0:
+					// Profiler counters on top of the terminal
+					state = PERF;
+					break;
+			}
+			break;
+		case PERF:
+			switch(keycode){
+				case 1:
+					console_str_in(perf_dump() ? "\nPerf: written to " PERF_FILE "\n" : "\nPerf: write failed\n");
+					break;
+				case 2:
+					perf_reset();
+					break;
 			}
 			break;
 		case CTRL:
@@ -335,6 +362,7 @@ void T2Input::numpad_input(int keycode){ //TODO: remake this
 
 void T2Input::handle_keyevt(VMINT event, VMINT keycode){
 	int time = vm_get_tick_count();
+	changed=true;
 	switch(event){
 		case VM_KEY_EVENT_UP:
 			switch(keycode){
@@ -376,6 +404,7 @@ void T2Input::handle_keyevt(VMINT event, VMINT keycode){
 							state=SET_MENU;
 							break;
 						case SET_MENU:
+						case PERF:
 							state=MAIN;
 							break;
 						case F_NUM:
@@ -405,48 +434,33 @@ void T2Input::handle_keyevt(VMINT event, VMINT keycode){
 	}
 }
 
+// Overlay text is white over the keys, both go through the console's glyph cache
 void T2Input::draw_xy_char(int x, int y, const char*str){
-	const unsigned short textcolor = 0xFFFF , backcolor = tr_color; 
-	const unsigned char *font_ch=ProFont6x11+5 + 12*(*str) + 1;
-
-	for(int i=0;i<char_height;++i){
-		unsigned short* scr_buf= (unsigned short*)this->scr_buf + x+(y+i)*scr_w;
-		for(int j=0;j<char_width;++j)
-			if(((*font_ch)>>j)&1)
-				scr_buf[j]=textcolor;;
-		++font_ch;
-	}
+	console.blit_glyph_over((unsigned short*)scr_buf + x+y*scr_w, scr_w, char_height, *str);
 }
 void T2Input::draw_xy_str(int x, int y, const char*str){
-	const unsigned short textcolor = 0xFFFF , backcolor = tr_color; 
-	for(int k = 0; str[k];++k){
-		const unsigned char *font_ch=ProFont6x11+5 + 12*(str[k]) + 1;
-
-		for(int i=0;i<char_height;++i){
-			unsigned short* scr_buf= (unsigned short*)this->scr_buf + x + k*char_width +(y+i)*scr_w;
-			for(int j=0;j<char_width;++j)
-				if(((*font_ch)>>j)&1)
-					scr_buf[j]=textcolor;
-			++font_ch;
-		}
-	}
+	for(int k = 0; str[k];++k)
+		console.blit_glyph_over((unsigned short*)scr_buf + x+k*char_width+y*scr_w, scr_w, char_height, str[k]);
 }
 
 void T2Input::draw_xy_str_color(int x, int y, unsigned short textcolor,  unsigned short backcolor, const char*str){
-	for(int k = 0; str[k];++k){
-		const unsigned char *font_ch=ProFont6x11+5 + 12*(str[k]) + 1;
-
-		for(int i=0;i<char_height;++i){
-			unsigned short* scr_buf= (unsigned short*)this->scr_buf + x+k*char_width+(y+i)*scr_w;
-			for(int j=0;j<char_width;++j)
-				scr_buf[j]=((((*font_ch)>>j)&1)?textcolor:backcolor);
-			++font_ch;
-		}
-	}
+	for(int k = 0; str[k];++k)
+		console.blit_glyph((unsigned short*)scr_buf + x+k*char_width+y*scr_w, scr_w, char_height, str[k], textcolor, backcolor);
 }
 extern "C" {
 	extern unsigned int last_wr_addr, last_rd_addr;
 	extern unsigned long cycles;
+	extern const char *core_dispatch;
+}
+
+// Anything on the overlay that differs from the last draw()?
+bool T2Input::need_draw(){
+	int time = vm_get_tick_count();
+	bool mode = !(time - last_input_time >= 1000 || last_input_time > time);
+
+	return changed || mode != drawn_mode || time - prev_tick >= T2INPUT_STATUS_MS ||
+		console.cursor_x != drawn_cursor_x || console.cursor_y != drawn_cursor_y ||
+		console.cur_textcolor != drawn_cursor_color;
 }
 
 void T2Input::draw(){
@@ -454,15 +468,20 @@ void T2Input::draw(){
 	typedef const char * temp[10][10];
 	const unsigned short gray_color = VM_COLOR_888_TO_565(50, 50, 50); 
 
-	{
-		char tmp[100];
-		sprintf(tmp, "%#08X %#08X %ul kHz", last_wr_addr, last_rd_addr, (cycles - prev_cycle)/(vm_get_tick_count() - prev_tick));
-		draw_xy_str_color(0, 0, 0xFFFF, gray_color, tmp);
+	if(time - prev_tick >= T2INPUT_STATUS_MS || !status[0]){
+		sprintf(status, "%#08X %#08X %ul kHz %.3s", last_wr_addr, last_rd_addr, (cycles - prev_cycle)/(time - prev_tick ? time - prev_tick : 1), core_dispatch);
 		
 		// Set the variables
-		prev_tick = vm_get_tick_count(); // Get the current tick count
+		prev_tick = time; // Get the current tick count
 		prev_cycle = cycles;
 	}
+	draw_xy_str_color(0, 0, 0xFFFF, gray_color, status);
+
+	changed = false;
+	drawn_mode = !(time - last_input_time >= 1000 || last_input_time > time);
+	drawn_cursor_x = console.cursor_x;
+	drawn_cursor_y = console.cursor_y;
+	drawn_cursor_color = console.cur_textcolor;
 
 	if(draw_kb){ // draw screen keyboard
 		show_current_pressed_key();
@@ -551,6 +570,13 @@ void T2Input::draw(){
 					draw_xy_str(m_x+(key_w-char_width*strlen(Fnum_keyboard[k]))/2, m_y + key_h/2-char_height/2, Fnum_keyboard[k]);
 				}
 				break;
+			case PERF:
+				draw_xy_str(key_w*2+key_w/2 -strlen("Cancel")*char_width/2, keyboard_h + (key_h/2-char_height)/2, "Cancel");
+				for(int k=0; k<2; ++k){
+					int m_x = (k%3)*key_w, m_y = (k/3)*key_h+keyboard_h+key_h;
+					draw_xy_str(m_x+(key_w-char_width*strlen(perf_keyboard[k]))/2, m_y + key_h/2-char_height/2, perf_keyboard[k]);
+				}
+				break;
 			case CTRL:
 				draw_xy_str(key_w/2 -strlen("SET")*char_width/2, scr_h - key_h + (key_h-char_height)/2, "SET");
 				draw_xy_str(key_w*2+key_w/2 -strlen("Cancel")*char_width/2, keyboard_h + (key_h/2-char_height)/2, "Cancel");
@@ -584,6 +610,14 @@ void T2Input::draw(){
 		}
 	}
 
+	if(state==PERF){ // counters under the status bar, redrawn with it
+		char line[PERF_LINE];
+		for(int i=0; perf_line(i, line, 0); ++i){
+			vm_graphic_fill_rect(scr_buf, 0, (i+1)*char_height, scr_w, char_height, gray_color, gray_color);
+			draw_xy_str_color(0, (i+1)*char_height, 0xFFFF, gray_color, line);
+		}
+	}
+
 	if(!(time - last_input_time >= 1000 || last_input_time > time)){ //draw input mode
 		int y = (console.cursor_y==0?char_height:0), x = scr_w - 3*char_width;
 		draw_xy_str_color(x,y,0xFFFF,gray_color,imput_modes[(int)cur_input_mode]);
@@ -692,6 +726,9 @@ void T2Input::init(){
 	cur_input_mode = SMALL;
 	last_input_time = 0;
 
+	changed = true;
+	status[0] = 0;
+
 	state = MAIN;
 
 	squares[0][0] = key_w, squares[0][1] = keyboard_h;
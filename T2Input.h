@@ -4,6 +4,10 @@
 
 #include "main.h"
 
+#ifndef T2INPUT_STATUS_MS
+#define T2INPUT_STATUS_MS 500 // Status bar refresh period
+#endif
+
 class T2Input
 {
 public:
@@ -21,7 +25,8 @@ public:
 		F_NUM,
 		SET_MENU,
 		CTRL,
-		CTRL_SECOND_CLICK
+		CTRL_SECOND_CLICK,
+		PERF
 	};
 
 	Input_mode cur_input_mode;
@@ -38,6 +43,13 @@ public:
 
 	bool draw_kb;
 
+	// What the overlay was last drawn from, see need_draw()
+	bool changed;           // Set by input events
+	bool drawn_mode;        // Input mode indicator was shown
+	int drawn_cursor_x, drawn_cursor_y;
+	unsigned short drawn_cursor_color;
+	char status[100];       // Status bar text, updated every T2INPUT_STATUS_MS
+
 	int current_key;
 
 	int squares[8][2];
@@ -57,6 +69,7 @@ public:
 	void draw_xy_str(int x, int y, const char*str);
 	void draw_xy_str_color(int x, int y, unsigned short textcolor,  unsigned short backcolor, const char*str);
 
+	bool need_draw();
 	void draw();
 	void init();
 	~T2Input(void);
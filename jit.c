@@ -0,0 +1,472 @@
+/*
+ * RV32IMA -> Thumb basic-block translator for mrv32, see jit.h.
+ *
+ * Each guest instruction becomes a short template working on r0-r3, with
+ * r7 pointing at the guest register file. A block ends at the first
+ * branch/jump, when it is full, or before an instruction it doesn't handle.
+ * Loads and stores check the address against RAM first; outside of it the
+ * block exits before the access and the interpreter redoes that instruction.
+ *
+ * Block layout:
+ *   push {r4-r7, lr}; adds r7, r0, #0
+ *   ...guest instructions, exits set r0 = next PC, r1 = instructions run...
+ *   epilogue: pop {r4-r7}; pop {r3}; bx r3
+ *   literal pool
+ * Calls to C go through a "bx r3" at the start of the buffer, reached with BL.
+ */
+
+#include "jit.h"
+#include "string.h"
+
+#ifdef JIT_ENABLE
+
+typedef void* (*vm_malloc_nc_t)(int size);
+typedef VMINT(*vm_get_sym_entry_t)(char* symbol);
+extern vm_get_sym_entry_t vm_get_sym_entry;
+
+jit_block_t jit_blocks[JIT_TABLE_SIZE];
+VMUINT32 jit_code_pages[(JIT_MAX_RAM >> 12) / 32];
+VMUINT16 *jit_code = NULL;
+
+#define JIT_RAM_BASE 0x80000000
+#define JIT_MAX_BLOCK_BYTES 1024                // Worst case is well under this, emit() drops a block that gets there
+#define JIT_MAX_LITS 64
+#define JIT_MAX_FIXUPS 96
+
+static jit_bus_t jit_bus;
+static VMUINT32 jit_ram_size;
+static VMUINT32 jit_used;                       // Bytes of the code buffer in use
+
+// Emitter state for the block being translated
+static VMUINT16 *jit_p;
+static VMUINT16 *jit_limit;                     // End of the JIT_MAX_BLOCK_BYTES the block may take
+static VMUINT32 jit_lits[JIT_MAX_LITS];
+static int jit_nlits;
+static VMUINT16 *jit_lit_at[JIT_MAX_FIXUPS];    // LDR Rd, [pc, #x] to patch
+static VMUINT8 jit_lit_idx[JIT_MAX_FIXUPS];
+static int jit_nlit_fix;
+static VMUINT16 *jit_exit_at[JIT_MAX_INSNS * 2]; // B epilogue to patch
+static int jit_nexits;
+static int jit_overflow;
+
+// Thumb condition codes
+#define T_EQ 0
+#define T_NE 1
+#define T_CS 2
+#define T_CC 3
+#define T_GE 10
+#define T_LT 11
+
+// Thumb ALU (format 4) opcodes
+#define T_AND 0
+#define T_EOR 1
+#define T_LSL 2
+#define T_LSR 3
+#define T_ASR 4
+#define T_CMP 10
+#define T_ORR 12
+#define T_MUL 13
+#define T_BIC 14
+
+#define RV_REG 7                                // Host register holding the guest register file
+
+static void emit(VMUINT16 h) {
+	if (jit_p == jit_limit) {
+		jit_overflow = 1;
+		return;
+	}
+	*jit_p++ = h;
+}
+
+static void emit_alu(int op, int rd, int rm) {
+	emit(0x4000 | (op << 6) | (rm << 3) | rd);
+}
+
+// rd = value
+static void emit_const(int rd, VMUINT32 value) {
+	int i;
+
+	if (value < 256) {
+		emit(0x2000 | (rd << 8) | value);       // movs rd, #value
+		return;
+	}
+	for (i = 0; i < jit_nlits && jit_lits[i] != value; i++)
+		;
+	if (i == jit_nlits) {
+		if (jit_nlits == JIT_MAX_LITS) {
+			jit_overflow = 1;
+			i = 0;
+		} else
+			jit_lits[jit_nlits++] = value;
+	}
+	if (jit_nlit_fix == JIT_MAX_FIXUPS) {
+		jit_overflow = 1;
+		return;
+	}
+	jit_lit_at[jit_nlit_fix] = jit_p;
+	jit_lit_idx[jit_nlit_fix++] = i;
+	emit(0x4800 | (rd << 8));                   // ldr rd, [pc, #pool]
+}
+
+// rd = x[reg]
+static void emit_load_reg(int rd, int reg) {
+	if (reg == 0)
+		emit(0x2000 | (rd << 8));               // movs rd, #0
+	else
+		emit(0x6800 | (reg << 6) | (RV_REG << 3) | rd); // ldr rd, [r7, #reg*4]
+}
+
+// x[reg] = rs
+static void emit_store_reg(int rs, int reg) {
+	if (reg != 0)
+		emit(0x6000 | (reg << 6) | (RV_REG << 3) | rs); // str rs, [r7, #reg*4]
+}
+
+// r0 = x[reg] + imm, with a scratch in r1
+static void emit_add_imm(int reg, VMUINT32 imm) {
+	if (reg == 0) {
+		emit_const(0, imm);
+		return;
+	}
+	emit_load_reg(0, reg);
+	if (imm == 0)
+		return;
+	if (imm < 256)
+		emit(0x3000 | imm);                     // adds r0, #imm
+	else if (-imm < 256)
+		emit(0x3800 | -imm);                    // subs r0, #-imm
+	else {
+		emit_const(1, imm);
+		emit(0x1800 | (1 << 6) | (0 << 3) | 0); // adds r0, r0, r1
+	}
+}
+
+// Leave the block with r0 = pc, r1 = n
+static void emit_exit(VMUINT32 n, VMUINT32 pc, int last) {
+	emit(0x2100 | n);                           // movs r1, #n
+	emit_const(0, pc);
+	if (!last) {
+		jit_exit_at[jit_nexits++] = jit_p;
+		emit(0xE000);                           // b epilogue
+	}
+}
+
+// Call a C helper, arguments in r0/r1, result in r0
+static void emit_call(void *fn) {
+	VMINT32 ofs;
+
+	emit_const(3, (VMUINT32)fn);
+	ofs = ((VMINT32)((char*)jit_code - (char*)jit_p) - 4) >> 1; // BL to the "bx r3" at jit_code
+	emit(0xF000 | ((ofs >> 11) & 0x7FF));
+	emit(0xF800 | (ofs & 0x7FF));
+}
+
+// r0 = RAM offset of x[reg] + imm. Exits before instruction n if that is not RAM.
+static void emit_ram_addr(int reg, VMUINT32 imm, VMUINT32 n, VMUINT32 pc) {
+	emit_add_imm(reg, imm - JIT_RAM_BASE);
+	emit_const(1, jit_ram_size - 3);           // Same bound as the interpreter
+	emit_alu(T_CMP, 0, 1);
+	emit(0xD000 | (T_CC << 8) | 2);             // bcc past the exit below
+	emit_exit(n, pc, 0);
+}
+
+static VMINT32 imm_i(VMUINT32 ir) {
+	return (VMINT32)ir >> 20;
+}
+
+// Emit guest instruction ir at pc, the n-th of the block.
+// Returns 1 if it ends the block, 0 to go on, -1 if it can't be translated.
+static int jit_emit_insn(VMUINT32 ir, VMUINT32 pc, VMUINT32 n) {
+	int rd = (ir >> 7) & 0x1f;
+	int rs1 = (ir >> 15) & 0x1f;
+	int rs2 = (ir >> 20) & 0x1f;
+	int funct3 = (ir >> 12) & 7;
+
+	switch (ir & 0x7f) {
+	case 0x37: // LUI
+		if (rd) {
+			emit_const(0, ir & 0xfffff000);
+			emit_store_reg(0, rd);
+		}
+		return 0;
+	case 0x17: // AUIPC
+		if (rd) {
+			emit_const(0, pc + (ir & 0xfffff000));
+			emit_store_reg(0, rd);
+		}
+		return 0;
+	case 0x6F: { // JAL
+		VMINT32 reladdy = ((ir & 0x80000000) >> 11) | ((ir & 0x7fe00000) >> 20) | ((ir & 0x00100000) >> 9) | ((ir & 0x000ff000));
+		if (reladdy & 0x00100000) reladdy |= 0xffe00000;
+		if (rd) {
+			emit_const(2, pc + 4);
+			emit_store_reg(2, rd);
+		}
+		emit_exit(n + 1, pc + reladdy, 1);
+		return 1;
+	}
+	case 0x67: // JALR
+		emit_add_imm(rs1, imm_i(ir));
+		emit(0x2101);                           // movs r1, #1
+		emit_alu(T_BIC, 0, 1);
+		if (rd) {
+			emit_const(2, pc + 4);
+			emit_store_reg(2, rd);
+		}
+		emit(0x2100 | (n + 1));                 // movs r1, #n+1
+		return 1;
+	case 0x63: { // Branch
+		static const VMUINT8 cond[8] = { T_EQ, T_NE, 0xff, 0xff, T_LT, T_GE, T_CC, T_CS };
+		VMUINT32 immm4 = ((ir & 0xf00) >> 7) | ((ir & 0x7e000000) >> 20) | ((ir & 0x80) << 4) | ((ir >> 31) << 12);
+		if (immm4 & 0x1000) immm4 |= 0xffffe000;
+		if (cond[funct3] == 0xff)
+			return -1;
+		emit_load_reg(0, rs1);
+		emit_load_reg(1, rs2);
+		emit_alu(T_CMP, 0, 1);
+		emit(0xD000 | (cond[funct3] << 8) | 2); // b<cond> to the taken exit
+		emit_exit(n + 1, pc + 4, 0);
+		emit_exit(n + 1, pc + immm4, 1);
+		return 1;
+	}
+	case 0x03: { // Load
+		void *fn;
+		switch (funct3) {
+		case 0: case 4: fn = (void*)jit_bus.load1; break;
+		case 1: case 5: fn = (void*)jit_bus.load2; break;
+		case 2: fn = (void*)jit_bus.load4; break;
+		default: return -1;
+		}
+		emit_ram_addr(rs1, imm_i(ir), n, pc);
+		emit_call(fn);
+		if (funct3 == 0 || funct3 == 1) { // Sign extend LB/LH
+			int sh = funct3 == 0 ? 24 : 16;
+			emit(0x0000 | (sh << 6));           // lsls r0, r0, #sh
+			emit(0x1000 | (sh << 6));           // asrs r0, r0, #sh
+		}
+		emit_store_reg(0, rd);
+		return 0;
+	}
+	case 0x23: { // Store
+		void *fn;
+		VMINT32 addy = ((ir >> 7) & 0x1f) | ((ir & 0xfe000000) >> 20);
+		if (addy & 0x800) addy |= 0xfffff000;
+		switch (funct3) {
+		case 0: fn = (void*)jit_bus.store1; break;
+		case 1: fn = (void*)jit_bus.store2; break;
+		case 2: fn = (void*)jit_bus.store4; break;
+		default: return -1;
+		}
+		emit_ram_addr(rs1, addy, n, pc);
+		emit_load_reg(1, rs2);
+		emit_call(fn);
+		return 0;
+	}
+	case 0x13: // Op-immediate
+	case 0x33: { // Op
+		int is_reg = !!(ir & 0x20);
+		VMINT32 imm = imm_i(ir);
+
+		if (is_reg && (ir & 0x02000000) && funct3 != 0)
+			return -1; // MULH/DIV/REM: no long multiply or divide in Thumb-1
+		if (rd == 0)
+			return 0;
+
+		if (!is_reg && (funct3 == 0 || funct3 == 1 || funct3 == 5)) {
+			int sh = imm & 0x1f;
+			switch (funct3) {
+			case 0: emit_add_imm(rs1, imm); break;
+			case 1: emit_load_reg(0, rs1); emit(0x0000 | (sh << 6)); break; // lsls r0, r0, #sh
+			case 5: // lsrs/asrs #0 would shift by 32
+				emit_load_reg(0, rs1);
+				if (sh)
+					emit(((ir & 0x40000000) ? 0x1000 : 0x0800) | (sh << 6));
+				break;
+			}
+			emit_store_reg(0, rd);
+			return 0;
+		}
+
+		emit_load_reg(0, rs1);
+		if (is_reg)
+			emit_load_reg(1, rs2);
+		else
+			emit_const(1, imm);
+
+		if (is_reg && (ir & 0x02000000)) { // MUL
+			emit_alu(T_MUL, 0, 1);
+			emit_store_reg(0, rd);
+			return 0;
+		}
+
+		switch (funct3) {
+		case 0:
+			if (is_reg && (ir & 0x40000000))
+				emit(0x1A00 | (1 << 6) | (0 << 3) | 0); // subs r0, r0, r1
+			else
+				emit(0x1800 | (1 << 6) | (0 << 3) | 0); // adds r0, r0, r1
+			break;
+		case 1: case 5: // Shift by register, masked to 5 bits like the interpreter
+			emit(0x221F);                       // movs r2, #31
+			emit_alu(T_AND, 1, 2);
+			emit_alu(funct3 == 1 ? T_LSL : (ir & 0x40000000) ? T_ASR : T_LSR, 0, 1);
+			break;
+		case 2: case 3: // SLT/SLTU
+			emit(0x2201);                       // movs r2, #1
+			emit_alu(T_CMP, 0, 1);
+			emit(0xD000 | ((funct3 == 2 ? T_LT : T_CC) << 8) | 0); // skip the next one if less
+			emit(0x2200);                       // movs r2, #0
+			emit_store_reg(2, rd);
+			return 0;
+		case 4: emit_alu(T_EOR, 0, 1); break;
+		case 6: emit_alu(T_ORR, 0, 1); break;
+		case 7: emit_alu(T_AND, 0, 1); break;
+		}
+		emit_store_reg(0, rd);
+		return 0;
+	}
+	default: // SYSTEM, FENCE, AMO, illegal
+		return -1;
+	}
+}
+
+// Fill in the literal pool and the exit branches. Returns 0 if something is out of range.
+// Blocks start word aligned, so alignment is worked out from offsets into jit_code.
+static int jit_finish(VMUINT16 *epilogue) {
+	VMUINT16 *pool;
+	int i;
+
+	if ((jit_p - jit_code) & 1)
+		emit(0x46C0);                           // nop, align the pool
+	pool = jit_p;
+	for (i = 0; i < jit_nlits; i++) {
+		emit(jit_lits[i] & 0xFFFF);
+		emit(jit_lits[i] >> 16);
+	}
+
+	for (i = 0; i < jit_nlit_fix; i++) {
+		VMUINT32 pc = (2 * (jit_lit_at[i] - jit_code) + 4) & ~3;
+		VMUINT32 ofs = (2 * (pool - jit_code) + 4 * jit_lit_idx[i] - pc) >> 2;
+		if (ofs > 255)
+			return 0;
+		*jit_lit_at[i] |= ofs;
+	}
+	for (i = 0; i < jit_nexits; i++)
+		*jit_exit_at[i] |= (epilogue - jit_exit_at[i] - 2) & 0x7FF;
+	return 1;
+}
+
+// Every page from the one holding first to the one holding last, by page number as first needn't be page aligned
+static void jit_mark_pages(VMUINT32 first, VMUINT32 last) {
+	VMUINT32 p;
+
+	for (p = first >> 12; p <= last >> 12; p++)
+		jit_code_pages[(p >> 5) & ((JIT_MAX_RAM >> 17) - 1)] |= 1u << (p & 31);
+}
+
+// Translate the block at pc into slot b. If the first instruction can't be
+// translated the slot remembers pc with len 0, so it isn't retried.
+void jit_translate(jit_block_t *b, VMUINT32 pc) {
+	VMUINT16 *start, *epilogue;
+	VMUINT32 n = 0, ofs = pc - JIT_RAM_BASE;
+	int r = 0;
+
+	if (jit_used + JIT_MAX_BLOCK_BYTES > JIT_CODE_SIZE)
+		jit_flush(); // Before b is set up, this clears every slot
+
+	b->pc = pc;
+	b->len = 0;
+	b->hits = 0;
+
+	start = jit_p = jit_code + jit_used / 2;
+	jit_limit = start + JIT_MAX_BLOCK_BYTES / 2;
+	jit_nlits = jit_nlit_fix = jit_nexits = jit_overflow = 0;
+
+	emit(0xB5F0);                               // push {r4-r7, lr}
+	emit(0x1C00 | (0 << 3) | RV_REG);           // adds r7, r0, #0
+
+	while (n < JIT_MAX_INSNS && ofs + 4 * n <= jit_ram_size - 4) {
+		VMUINT32 ir = jit_bus.load4(ofs + 4 * n);
+		if ((ir & 3) != 3)
+			break; // Compressed, left to the interpreter
+		r = jit_emit_insn(ir, pc + 4 * n, n);
+		if (r < 0)
+			break;
+		n++;
+		if (r > 0)
+			break;
+	}
+	if (n == 0)
+		return;
+	if (r <= 0)
+		emit_exit(n, pc + 4 * n, 1);
+
+	epilogue = jit_p;
+	emit(0xBCF0);                               // pop {r4-r7}
+	emit(0xBC08);                               // pop {r3}
+	emit(0x4718);                               // bx r3
+
+	if (jit_overflow || !jit_finish(epilogue))
+		return;
+
+	jit_used = ((char*)jit_p - (char*)jit_code + 3) & ~3;
+	jit_mark_pages(ofs, ofs + 4 * n - 1);
+	b->code = start;
+	b->len = n;
+}
+
+// Drop every block with code in the pages written at ofs
+void jit_invalidate(VMUINT32 ofs) {
+	VMUINT32 first = ofs >> 12, last = (ofs + 3) >> 12;
+	int i;
+
+	for (i = 0; i < JIT_TABLE_SIZE; i++) {
+		jit_block_t *b = &jit_blocks[i];
+		VMUINT32 bfirst, blast;
+		if (b->len == 0)
+			continue;
+		bfirst = (b->pc - JIT_RAM_BASE) >> 12;
+		blast = (b->pc - JIT_RAM_BASE + 4 * b->len - 1) >> 12;
+		if (blast >= first && bfirst <= last) {
+			b->pc = 0;
+			b->len = 0;
+		}
+	}
+	for (; first <= last; first++)
+		jit_code_pages[(first >> 5) & ((JIT_MAX_RAM >> 17) - 1)] &= ~(1u << (first & 31));
+}
+
+// Forget all translations and start over at the beginning of the buffer
+void jit_flush(void) {
+	memset(jit_blocks, 0, sizeof(jit_blocks));
+	memset(jit_code_pages, 0, sizeof(jit_code_pages));
+	jit_used = 4; // Keep the trampoline
+}
+
+// Returns 0 if there is no executable memory, the interpreter then runs everything
+int jit_init(const jit_bus_t *bus, VMUINT32 ram_size) {
+	vm_malloc_nc_t malloc_nc = (vm_malloc_nc_t)vm_get_sym_entry("vm_malloc_nc");
+
+	if (malloc_nc == NULL)
+		return 0;
+	jit_code = (VMUINT16*)malloc_nc(JIT_CODE_SIZE);
+	if (jit_code == NULL)
+		return 0;
+
+	jit_bus = *bus;
+	jit_ram_size = ram_size;
+	jit_code[0] = 0x4718;                       // bx r3, see emit_call()
+	jit_code[1] = 0x46C0;                       // nop
+	jit_flush();
+	return 1;
+}
+
+void jit_deinit(void) {
+	if (jit_code)
+		vm_free(jit_code);
+	jit_code = NULL;
+	memset(jit_blocks, 0, sizeof(jit_blocks));
+	memset(jit_code_pages, 0, sizeof(jit_code_pages));
+}
+
+#endif
@@ -0,0 +1,105 @@
+#pragma once
+#include "vmsys.h"
+#include "stdint.h"
+
+/*
+ * Basic-block translator from RV32IMA to ARM Thumb (ARMv4T, Thumb-1 only).
+ * Hot guest blocks are compiled into a code buffer and run from
+ * MiniRV32IMAStep through MINIRV32_BLOCK_EXEC. Guest registers stay in
+ * MiniRV32IMAState.regs, RAM accesses call the same load/store helpers as
+ * the interpreter. Anything else (MMIO, CSRs, AMOs, MULH/DIV, traps) ends
+ * the block and is left to the interpreter, and so are compressed
+ * instructions and blocks that don't start on a word.
+ *
+ * Only built for the handset. The code buffer comes from vm_malloc_nc, so
+ * instruction fetches never see stale cache lines; without it the
+ * translator stays off and everything runs interpreted.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if !defined(WIN32) && !defined(JIT_DISABLE)
+#define JIT_ENABLE
+#endif
+
+#ifndef JIT_CODE_SIZE
+#define JIT_CODE_SIZE (64 * 1024)             // Code buffer, flushed as a whole when full
+#endif
+#ifndef JIT_TABLE_BITS
+#define JIT_TABLE_BITS 10                     // Block table entries, direct mapped by PC
+#endif
+#define JIT_TABLE_SIZE (1 << JIT_TABLE_BITS)
+#define JIT_MAX_INSNS 16                      // Guest instructions per block
+#define JIT_HOT 32                            // Interpreted visits to a table slot before translating
+#define JIT_MAX_RAM (64 * 1024 * 1024)        // RAM covered by the code page bitmap
+
+// Guest memory bus, offsets are relative to the start of guest RAM
+typedef struct {
+	VMUINT32 (*load1)(VMUINT32 ofs);
+	VMUINT32 (*load2)(VMUINT32 ofs);
+	VMUINT32 (*load4)(VMUINT32 ofs);
+	void (*store1)(VMUINT32 ofs, VMUINT32 val);
+	void (*store2)(VMUINT32 ofs, VMUINT32 val);
+	void (*store4)(VMUINT32 ofs, VMUINT32 val);
+} jit_bus_t;
+
+// Translated code returns the next guest PC in the low word and the number of
+// guest instructions it ran in the high word
+typedef uint64_t (*jit_fn_t)(VMUINT32 *regs);
+
+typedef struct {
+	VMUINT32 pc;                              // Guest PC of the block, 0 if the slot is free
+	VMUINT16 len;                             // Guest instructions, 0 if pc can't be translated
+	VMUINT16 hits;
+	VMUINT16 *code;
+} jit_block_t;
+
+#ifdef JIT_ENABLE
+
+extern jit_block_t jit_blocks[JIT_TABLE_SIZE];
+extern VMUINT32 jit_code_pages[(JIT_MAX_RAM >> 12) / 32];
+extern VMUINT16 *jit_code;                    // NULL when the translator is off
+
+int jit_init(const jit_bus_t *bus, VMUINT32 ram_size);
+void jit_deinit(void);
+void jit_flush(void);
+void jit_translate(jit_block_t *b, VMUINT32 pc);
+void jit_invalidate(VMUINT32 ofs);
+
+#ifndef JIT_CALL
+#define JIT_CALL( b, regs ) ((jit_fn_t)((char*)(b)->code + 1))(regs) // +1: Thumb entry
+#endif
+
+// Run the block at pc if there is one and it fits in budget instructions.
+// Returns 0 in the high word if nothing ran.
+static inline uint64_t jit_exec(VMUINT32 *regs, VMUINT32 pc, VMUINT32 budget) {
+	jit_block_t *b = &jit_blocks[(pc >> 2) & (JIT_TABLE_SIZE - 1)];
+
+	if (pc & 3)
+		return 0; // Between words, only compressed code gets there
+	if (b->pc != pc) {
+		if (jit_code == NULL || ++b->hits < JIT_HOT)
+			return 0;
+		jit_translate(b, pc);
+	}
+	if (b->len == 0 || b->len > budget)
+		return 0;
+	return JIT_CALL(b, regs);
+}
+
+// Call before every store to guest RAM
+static inline void jit_store_check(VMUINT32 ofs) {
+	if ((jit_code_pages[(ofs >> 17) & ((JIT_MAX_RAM >> 17) - 1)] & (1u << ((ofs >> 12) & 31))) ||
+		(jit_code_pages[((ofs + 3) >> 17) & ((JIT_MAX_RAM >> 17) - 1)] & (1u << (((ofs + 3) >> 12) & 31))))
+		jit_invalidate(ofs);
+}
+
+#else
+#define jit_store_check( ofs )
+#endif
+
+#ifdef __cplusplus
+}
+#endif
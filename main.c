@@ -19,24 +19,68 @@
 // C++ to C call :)
 #include "Console_io.h"
 
-// FIFO
-#include "fifo.h"
+// RAM file page cache
+#include "vram.h"
+
+// Snapshots
+#include "snap.h"
+
+// RV32 -> Thumb translator
+#include "jit.h"
+
+// Devices
+#include "mmio.h"
+#include "uart.h"
+#include "plic.h"
+#include "pvcon.h"
+#include "vblk.h"
+#include "perf.h"
 
 // Macros
-#define VRAM_FILE "e:\\rv32ima\\vram.bin"    // Virtual RAM file
+#define VRAM_FILE "e:\\rv32ima\\vram.bin"    // Virtual RAM file, or a boot image used as VRAM_BASE_FILE
+#define VRAM_BASE_FILE "e:\\rv32ima\\base.bin" // If present, read-only RAM or boot image (tools/mkimg) with writes going to VRAM_OVERLAY_FILE instead of VRAM_FILE
+#define VRAM_OVERLAY_FILE "e:\\rv32ima\\vram.cow" // Pages written over VRAM_BASE_FILE, delete it to reset the guest
+#define VBLK_FILE "e:\\rv32ima\\disk.img"    // Block device image, read-only if it can't be opened for writing
 
 #define SCREEN_FPS 20
 
+// Devices the core used to decode itself, see soc_mmio_init()
+#define CLINT_BASE 0x11000000
+#define CLINT_SIZE 0x10000
+#define SYSCON_BASE 0x11100000
+#define SYSCON_SIZE 0x1000
+
+// RAM file cache config
+#define RESIDENT_RAM_MAX (4 * 1024 * 1024) // Most guest RAM to keep in the heap instead of the file, 0 to disable
+#define RESIDENT_RAM_HIGH (64 * 1024)      // Part of that taken from the top of RAM (DTB, early stack)
+
 // mini-rv32ima config macros
-#define DTB_SIZE 1536             // DTB size (in bytes), must recount manually each time DTB changes
+#define DTB_SIZE 2048             // Room for the DTB (in bytes) below the core state in raw RAM images, mrv32.dts is padded to this
+#define DTB_SIZE_LEGACY 1536      // Same for images built with the stock mini-rv32ima DTB. Boot images say where theirs is.
 #define TIME_DIVISOR 1
 
+// CLINT timebase config
+#define TIMEBASE_CYCLES 0         // Guest time follows the instruction count (TIME_DIVISOR)
+#define TIMEBASE_WALLCLOCK 1      // Guest time follows vm_get_tick_count()
+#define TIMEBASE_DEFAULT TIMEBASE_WALLCLOCK
+#define TIMEBASE_RATE 1000        // Timer ticks per ms in wall clock mode, must match timebase-frequency in the DTB
+#define TIMEBASE_MAX_GAP 1000     // Longest gap (ms) credited at once in wall clock mode (pause, resume from INACTIVE...)
+
 #ifdef WIN32
-#define INSTRS_PER_FLIP 524288    // Number of instructions executed before checking status. See loop()
+#define INSTRS_PER_FLIP 524288    // Number of instructions per MiniRV32IMAStep call (timer interrupts are checked in between). See socRun()
 #else
-#define INSTRS_PER_FLIP 2048      // Number of instructions executed before checking status. See loop()
+#define INSTRS_PER_FLIP 2048      // Number of instructions per MiniRV32IMAStep call (timer interrupts are checked in between). See socRun()
 #endif
 
+// socRun scheduler config
+#define SOC_BUDGET_INTERACTIVE 30 // Time (ms) one socRun call may take shortly after a key or pen event
+#define SOC_BUDGET_IDLE 80        // Time (ms) one socRun call may take otherwise
+#define SOC_INTERACTIVE_TIME 1000 // How long (ms) after an input event the budget stays interactive
+#define SOC_MAX_BURST (256 * INSTRS_PER_FLIP)
+#define SOC_MAX_SLEEP 500         // Longest (ms) socRun sleeps on WFI, also when no timer is armed
+#define SOC_LAZY_FILL 8           // Pages copied from a resumed snapshot into the RAM file per WFI sleep, see vram_lazy_fill()
+#define SOC_WRITEBACK 32          // Dirty cached pages written back per WFI sleep, see vram_writeback()
+
 // Global variables
 int scr_w; 
 int scr_h;
@@ -44,11 +88,12 @@ unsigned int last_wr_addr = 0, last_rd_addr = 0;
 unsigned long cycles;
 
 // mini-rv32ima global variables
-const VMUINT32 RAM_SIZE = 12582912; // Minimum RAM amount (in bytes), just tested (may reduce further by custom kernel)
+VMUINT32 RAM_SIZE = 12582912; // Minimum RAM amount (in bytes) for raw RAM images, just tested (may reduce further by custom kernel). Boot images set their own.
 uint64_t lastTime = 0;
 int fail_on_all_faults = 0;
 
 // vmstate values:
+// -2: couldn't start (no memory for the RAM cache or the core), stays paused
 // -1: on startup
 //  0: pause
 //  1: run
@@ -61,18 +106,27 @@ int screen_timer_id = -1;
 
 int soc_cycle_timer_id = -1; // emulator cycle timer id
 
+// socRun scheduler state, see socRun()
+VMUINT32 soc_budget_ms = SOC_BUDGET_INTERACTIVE; // Current time budget of a socRun call
+VMUINT32 soc_burst = INSTRS_PER_FLIP;            // Instructions the next socRun call plans to run
+VMUINT32 soc_achieved = 0;                       // Instructions the last socRun call ran
+VMUINT32 soc_achieved_ms = 0;                    // and the time it took
+VMUINT32 soc_last_input = 0;                     // Tick count of the last key or pen event
+int soc_sleeping = 0;                            // soc_cycle_timer_id is a one-shot WFI wakeup
+
+// CLINT timebase state
+int soc_timebase = TIMEBASE_DEFAULT;             // TIMEBASE_CYCLES or TIMEBASE_WALLCLOCK
+VMUINT32 soc_timebase_rate = TIMEBASE_RATE;      // Timer ticks per ms in wall clock mode
+VMUINT32 soc_last_tick = 0;                      // Tick count the guest timer was last advanced to
+
 // File handlers for virtual RAM disk
 VMFILE vram;
 
-extern fifo_t serial_in;
+extern ring_t serial_in;
 
 typedef VMINT(*vm_get_sym_entry_t)(char* symbol);
 extern vm_get_sym_entry_t vm_get_sym_entry;
 
-typedef VMINT (*vm_file_seek_t)(VMFILE handle, VMINT offset, VMINT base);
-typedef VMINT (*vm_file_read_t)(VMFILE handle, void* data, VMUINT length, VMUINT* nread);
-typedef VMINT (*vm_file_write_t)(VMFILE handle, void* data, VMUINT length, VMUINT* written);
-
 vm_file_seek_t vm_file_seek_opt = 0;
 vm_file_read_t vm_file_read_opt = 0;
 vm_file_write_t vm_file_write_opt = 0;
@@ -100,11 +154,15 @@ void handle_sysevt(VMINT message, VMINT param);
 void handle_keyevt(VMINT event, VMINT keycode);
 void handle_penevt(VMINT event, VMINT x, VMINT y);
 
+// SoC cycle timer
+void socRun(int tid);
+
 // mini-rv32ima helper functions
 static VMUINT32 HandleException(VMUINT32 ir, VMUINT32 retval);
-static VMUINT32 HandleControlStore(VMUINT32 addy, VMUINT32 val);
-static VMUINT32 HandleControlLoad(VMUINT32 addy);
+static void soc_mmio_init(void);
 static void HandleOtherCSRWrite(VMUINT8* image, VMUINT16 csrno, VMUINT32 value);
+static void soc_irq_update(void);
+static void soc_dma_written(VMUINT32 ofs, VMUINT32 len);
 
 // Load / store helper
 static VMUINT32 store4(VMUINT32 ofs, VMUINT32 val);
@@ -114,6 +172,7 @@ static VMUINT8 store1(VMUINT32 ofs, VMUINT8 val);
 static VMUINT32 load4(VMUINT32 ofs);
 static VMUINT16 load2(VMUINT32 ofs);
 static VMUINT8 load1(VMUINT32 ofs);
+static VMUINT32 *amo_ptr(VMUINT32 ofs);
 
 // This is the functionality we want to override in the emulator.
 //  think of this as the way the emulator's processor is connected to the outside world.
@@ -121,10 +180,20 @@ static VMUINT8 load1(VMUINT32 ofs);
 #define MINIRV32_DECORATE  static
 #define MINI_RV32_RAM_SIZE RAM_SIZE
 #define MINIRV32_IMPLEMENTATION
-#define MINIRV32_POSTEXEC( pc, ir, retval ) { if( retval > 0 ) { if( fail_on_all_faults ) { console_str_in( "FAULT\n" ); return 3; } else retval = HandleException( ir, retval ); } }
-#define MINIRV32_HANDLE_MEM_STORE_CONTROL( addy, val ) if( HandleControlStore( addy, val ) ) return val;
-#define MINIRV32_HANDLE_MEM_LOAD_CONTROL( addy, rval ) rval = HandleControlLoad( addy );
+#define MINIRV32_POSTEXEC( pc, ir, retval ) { PERF_INC(perf.insn[(ir >> 2) & 31]); if( retval > 0 ) { if( fail_on_all_faults ) { console_str_in( "FAULT\n" ); return 3; } else retval = HandleException( ir, retval ); } }
+#define MINIRV32_CUSTOM_MMIO // Every device is in the mmio.h registry
+#define MINIRV32_HANDLE_MEM_STORE_CONTROL( addy, val ) if( mmio_store( addy, val ) ) { SETCSR( pc, pc + ilen ); return val; } // SYSCON
+#define MINIRV32_HANDLE_MEM_LOAD_CONTROL( addy, rval ) rval = mmio_load( addy );
 #define MINIRV32_OTHERCSR_WRITE( csrno, value ) HandleOtherCSRWrite( image, csrno, value );
+#define MINIRV32_TRAP( trap ) { if( trap & 0x80000000 ) PERF_INC(perf.interrupts); else PERF_INC(perf.traps); }
+#define MINIRV32_DECODE_CACHE // Keep predecoded instructions, saves a RAM fetch and a decode per instruction
+#define MINIRV32_RVC // Compressed instructions, kernels and userlands built for rv32imac run too
+#ifndef MINIRV32_SWITCH_DISPATCH
+#define MINIRV32_THREADED_DISPATCH // Computed goto opcode dispatch (GCC only). Build with -DMINIRV32_SWITCH_DISPATCH to compare with the switch core
+#endif
+#ifdef JIT_ENABLE
+#define MINIRV32_BLOCK_EXEC( pc, budget, ran ) { uint64_t r = jit_exec(state->regs, pc, budget); ran = (uint32_t)(r >> 32); if (ran) pc = (uint32_t)r; PERF_ADD(perf.jit_insns, ran); }
+#endif
 
 #define MINIRV32_CUSTOM_MEMORY_BUS
 #define MINIRV32_STORE4( ofs, val ) store4(ofs, val)
@@ -135,11 +204,23 @@ static VMUINT8 load1(VMUINT32 ofs);
 #define MINIRV32_LOAD2( ofs ) load2(ofs)
 #define MINIRV32_LOAD1_SIGNED( ofs ) (VMINT8)load1(ofs)
 #define MINIRV32_LOAD1( ofs ) load1(ofs)
+#define MINIRV32_AMO_PTR( ofs ) amo_ptr(ofs)
 
 // After all macros have been overwritten, now include the header
 #include "mini-rv32ima.h"
 
 struct MiniRV32IMAState *core; // core struct
+const char *core_dispatch = MINIRV32_DISPATCH_NAME; // Shown on the status bar next to the speed
+
+// Everything a snapshot holds besides RAM
+typedef struct {
+	struct MiniRV32IMAState core;
+	uint64_t lastTime;
+	uart_t uart;
+	plic_t plic;
+	pvcon_t pvcon;
+	vblk_t vblk;
+} soc_state_t;
 
 // Main MRE entry point
 void vm_main(void){
@@ -147,7 +228,11 @@ void vm_main(void){
 	vm_file_read_opt = vm_get_sym_entry("vm_file_read");
 	vm_file_write_opt = vm_get_sym_entry("vm_file_write");
 
-	serial_in = fifo_create(BUF_SIZE, sizeof(int));
+	ring_init(&serial_in, serial_in_buf, SERIAL_IN_SIZE);
+	uart_reset();
+	plic_reset();
+	soc_mmio_init();
+	perf_reset();
 
 	scr_w = vm_graphic_get_screen_width();
 	scr_h = vm_graphic_get_screen_height();
@@ -161,25 +246,142 @@ void vm_main(void){
 
 // Render terminal
 void draw(){
-	t2input_draw(layer_bufs[1]); // Call to C++
-	vm_graphic_flush_layer(layer_hdls, 2); // Flush layer
+	PERF_TIME_BEGIN(t);
+	int changed = console_flush(); // Terminal cells changed since the last frame
+	changed |= t2input_draw(layer_bufs[1]); // Call to C++
+	if (changed) { // Idle frames cost nothing
+		vm_graphic_flush_layer(layer_hdls, 2); // Flush layer
+		PERF_LAT(PERF_LAT_SHOWN);
+	}
+	PERF_TIME_END(t, perf.ms_draw);
+}
+
+// Run socRun after delay ms, 0 to run it back to back again
+static void soc_schedule(VMUINT32 delay) {
+	if (soc_cycle_timer_id != -1)
+		vm_delete_timer(soc_cycle_timer_id);
+	soc_cycle_timer_id = vm_create_timer(delay, socRun);
+	soc_sleeping = delay != 0;
+}
+
+// Cycle counter of the core. Read as two words: a uint64_t pointer to cyclel
+// breaks strict aliasing once MiniRV32IMAStep() is inlined, as the switch core is.
+static uint64_t soc_cycles(void) {
+	return ((uint64_t)core->cycleh << 32) | core->cyclel;
+}
+
+static void soc_add_cycles(uint64_t n) {
+	n += soc_cycles();
+	core->cyclel = (uint32_t)n;
+	core->cycleh = (uint32_t)(n >> 32);
+}
+
+// The guest is waiting for an interrupt, and the only source is the CLINT timer.
+// Move the timebase straight to timermatch so it fires on the next call, and
+// sleep for that long instead of polling. Input wakes us early, see handle_keyevt().
+static void soc_wfi(void) {
+	uint64_t timer = ((uint64_t)core->timerh << 32) | core->timerl;
+	uint64_t match = ((uint64_t)core->timermatchh << 32) | core->timermatchl;
+	VMUINT32 delay = SOC_MAX_SLEEP;
+
+	if (match == 0) {
+		if (soc_timebase == TIMEBASE_CYCLES)
+			soc_add_cycles(INSTRS_PER_FLIP); // Timer not armed, keep time moving
+	} else if (match >= timer) {
+		uint64_t delta = match - timer + 1; // Fires once timer > match
+		if (soc_timebase == TIMEBASE_CYCLES) {
+			soc_add_cycles(delta * TIME_DIVISOR);
+			delta /= 1000; // Timer ticks are microseconds
+		} else {
+			delta = (delta + soc_timebase_rate - 1) / soc_timebase_rate; // Real time does the fast-forward
+		}
+		if (delta < SOC_MAX_SLEEP)
+			delay = (VMUINT32)delta;
+	} else {
+		delay = 0; // Already due
+	}
+
+	if (delay) {
+		// Idle anyway: clean the cache so misses don't have to write, and make the RAM file whole again a little at a time
+		vram_writeback(SOC_WRITEBACK);
+		vram_lazy_fill(SOC_LAZY_FILL);
+		soc_schedule(delay);
+	}
+}
+
+// Timer ticks since the last call
+static VMUINT32 soc_elapsed(uint64_t ccount) {
+	VMUINT32 ticks = (VMUINT32)(ccount / TIME_DIVISOR - lastTime);
+	lastTime += ticks; // Kept in step in both modes, so switching doesn't make time jump
+
+	if (soc_timebase == TIMEBASE_WALLCLOCK) {
+		VMUINT32 now = vm_get_tick_count();
+		VMUINT32 gap = now - soc_last_tick;
+		if (gap > TIMEBASE_MAX_GAP)
+			gap = TIMEBASE_MAX_GAP;
+		soc_last_tick = now;
+		ticks = gap * soc_timebase_rate;
+	}
+	return ticks;
 }
 
 // SoC cycle
+// Runs a burst of soc_burst instructions, INSTRS_PER_FLIP at a time, then
+// rescales soc_burst from the time it took so the next call takes about
+// soc_budget_ms. The budget is short while the user is typing and longer
+// when nobody is, trading UI latency for throughput.
 void socRun(int tid){
+	if (soc_sleeping)
+		soc_schedule(0); // Woke up from WFI, back to running continuously
+
 	if (vmstate == 1) {
 		// Emulator cycle
-		uint64_t* this_ccount = ((uint64_t*)&core->cyclel);
-		VMUINT32 elapsedUs = 0;
-		elapsedUs = *this_ccount / TIME_DIVISOR - lastTime;
-		cycles = *this_ccount; // For calculating the emulated speed
-		lastTime += elapsedUs;
+		uint64_t start_ccount = soc_cycles();
+		VMUINT32 start = vm_get_tick_count(), elapsed;
+		int ret = 0;
+
+		soc_budget_ms = (start - soc_last_input < SOC_INTERACTIVE_TIME) ? SOC_BUDGET_INTERACTIVE : SOC_BUDGET_IDLE;
+
+		while (soc_cycles() - start_ccount < soc_burst) {
+			VMUINT32 elapsedUs = soc_elapsed(soc_cycles());
+
+			if (!pvcon_poll()) // Input that arrived since the last step may raise an interrupt
+				uart_poll();
+			soc_irq_update();
+
+			ret = MiniRV32IMAStep(core, NULL, 0, elapsedUs, INSTRS_PER_FLIP); // Execute upto INSTRS_PER_FLIP cycles before breaking out.
+			if (ret != 0)
+				break; // WFI or SYSCON, idle until the next call
+			if (vm_get_tick_count() - start >= soc_budget_ms)
+				break; // Slower than planned (page cache misses...), don't overrun
+		}
+
+		uart_tx_flush(); // Render what the guest printed in one go
+
+		elapsed = vm_get_tick_count() - start;
+		soc_achieved = (VMUINT32)(soc_cycles() - start_ccount);
+		soc_achieved_ms = elapsed;
+		cycles = soc_cycles(); // For calculating the emulated speed
+		PERF_ADD(perf.ms_run, elapsed);
+
+		// Only a busy burst says something about speed
+		if (ret == 0) {
+			VMUINT32 target;
+			if (elapsed == 0)
+				target = soc_burst * 2;
+			else
+				target = (VMUINT32)((uint64_t)soc_achieved * soc_budget_ms / elapsed);
+			soc_burst = (soc_burst + target) / 2;
+			if (soc_burst < INSTRS_PER_FLIP)
+				soc_burst = INSTRS_PER_FLIP;
+			if (soc_burst > SOC_MAX_BURST)
+				soc_burst = SOC_MAX_BURST;
+		}
 
-		int ret = MiniRV32IMAStep(core, NULL, 0, elapsedUs, INSTRS_PER_FLIP); // Execute upto INSTRS_PER_FLIP cycles before breaking out.
 		switch (ret)
 		{
 			case 0: break;
-			case 1: *this_ccount += INSTRS_PER_FLIP; break;
+			case 1: soc_wfi(); break;
 			//case 3: instct = 0; break;
 			//case 0x7777: goto restart;  //syscon code for restart
 			case 0x5555: console_str_in("POWEROFF!\n"); vmstate = 0; //syscon code for power-off . halt
@@ -192,6 +394,12 @@ void socRun(int tid){
 void save_state() {
 	VMUINT n;	   // Required for read/write apis, but useless
 
+	if (vmstate == -2)
+		return; // No core, see handle_sysevt()
+
+	// The state is only valid together with the RAM file, so write back cached pages first
+	vram_flush();
+
 	// Open state file
 	VMWCHAR state_path[100];
 	vm_gb2312_to_ucs2(state_path, 1000, "e:\\rv32ima\\state.bin");
@@ -201,15 +409,45 @@ void save_state() {
 
 	vm_file_write_opt(sf, (char*)core, sizeof(struct MiniRV32IMAState), &n);
 	vm_file_write_opt(sf, (char*)&lastTime, sizeof(lastTime), &n);
+	vm_file_write_opt(sf, (char*)&uart, sizeof(uart), &n);
+	vm_file_write_opt(sf, (char*)&plic, sizeof(plic), &n);
+	vm_file_write_opt(sf, (char*)&pvcon, sizeof(pvcon), &n);
+	vm_file_write_opt(sf, (char*)&vblk, sizeof(vblk), &n);
 
 	// Close file
 	vm_file_close(sf);
+
+	// Snapshot for load_state(), only the pages dirtied since the last one after the first
+	{
+		soc_state_t st;
+		st.core = *core;
+		st.lastTime = lastTime;
+		st.uart = uart;
+		st.plic = plic;
+		st.pvcon = pvcon;
+		st.vblk = vblk;
+		if (!snap_save(&st, sizeof(st)))
+			console_str_in("\nSnapshot failed\n");
+	}
+}
+
+// Code and device state came from a file, forget what was derived from the old one
+static void soc_restored(void) {
+#ifdef MINIRV32_DECODE_CACHE
+	// Drop instructions decoded from the old state
+	MiniRV32IMAFlushDecodeCache();
+#endif
+#ifdef JIT_ENABLE
+	jit_flush();
+#endif
 }
 
 // Load state only, not RAM
 void load_man() {
 	VMWCHAR state_path[100];
 	VMUINT n; // Required for read/write apis, but useless
+	if (vmstate == -2)
+		return;
 	vm_gb2312_to_ucs2(state_path, 1000, "e:\\rv32ima\\state.bin");
 	VMFILE sf = vm_file_open(state_path, // State load/save file
 		MODE_APPEND,					 // Open in append mode
@@ -220,13 +458,50 @@ void load_man() {
 	vm_file_read_opt(sf, (char*)core, sizeof(struct MiniRV32IMAState), &n);
 	vm_file_read_opt(sf, (char*)&lastTime, sizeof(lastTime), &n);
 
+	// Device state, missing from files saved before the UART had registers
+	n = 0;
+	vm_file_read_opt(sf, (char*)&uart, sizeof(uart), &n);
+	if (n != sizeof(uart)) {
+		uart_reset();
+		uart.ier = 0x05; // The guest's 8250 driver enabled RX interrupts before this was saved, and won't again
+	}
+	n = 0;
+	vm_file_read_opt(sf, (char*)&plic, sizeof(plic), &n);
+	if (n != sizeof(plic))
+		plic_reset();
+	n = 0;
+	vm_file_read_opt(sf, (char*)&pvcon, sizeof(pvcon), &n);
+	if (n != sizeof(pvcon))
+		pvcon_reset();
+	n = 0;
+	vm_file_read_opt(sf, (char*)&vblk, sizeof(vblk), &n);
+	if (n != sizeof(vblk))
+		vblk_reset();
+
 	// Close file
 	vm_file_close(sf);
+
+	soc_restored();
 }
 
-// Load emulator's state
+// Load emulator's state: RAM and devices from the latest snapshot
 void load_state() {
-	// Do nothing for now
+	soc_state_t st;
+
+	if (vmstate == -2)
+		return;
+	if (!snap_load(&st, sizeof(st))) {
+		console_str_in("\nNo snapshot to load\n");
+		return;
+	}
+	*core = st.core;
+	lastTime = st.lastTime;
+	uart = st.uart;
+	plic = st.plic;
+	pvcon = st.pvcon;
+	vblk = st.vblk;
+
+	soc_restored();
 }
 
 // Refresh screen
@@ -235,78 +510,87 @@ void timer(int tid) {
 }
 
 // Load / store helper
+// All of these go through the RAM file page cache, see vram.h
 static VMUINT32 store4(VMUINT32 ofs, VMUINT32 val) {
 	last_wr_addr = ofs;
-	vm_file_seek_opt(vram, ofs, BASE_BEGIN);
-
-	VMUINT32 r = val;
-	VMUINT w;
-
-	vm_file_write_opt(vram, ((VMUINT8*)&r), 4, &w);
+	PERF_INC(perf.stores);
+	jit_store_check(ofs);
+	vram_store4(ofs, val);
+	return val;
 }
 
 static VMUINT16 store2(VMUINT32 ofs, VMUINT16 val) {
 	last_wr_addr = ofs;
-	vm_file_seek_opt(vram, ofs, BASE_BEGIN);
-
-	VMUINT16 r = val;
-	VMUINT w;
-
-	vm_file_write_opt(vram, ((VMUINT8*)&r), 2, &w);
+	PERF_INC(perf.stores);
+	jit_store_check(ofs);
+	vram_store2(ofs, val);
+	return val;
 }
 
 static VMUINT8 store1(VMUINT32 ofs, VMUINT8 val) {
 	last_wr_addr = ofs;
-	vm_file_seek_opt(vram, ofs, BASE_BEGIN);
-
-	VMUINT8 r = val;
-	VMUINT w;
-
-	vm_file_write_opt(vram, ((VMUINT8*)&r), 1, &w);
+	PERF_INC(perf.stores);
+	jit_store_check(ofs);
+	vram_store1(ofs, val);
+	return val;
 }
 
 static VMUINT32 load4(VMUINT32 ofs) {
+	VMUINT32 val;
 	last_rd_addr = ofs;
+	PERF_INC(perf.loads);
 
-	if (ofs == 0xB8) {
-		return 0xFEE6DCE3;
-	}
-	
-	vm_file_seek_opt(vram, ofs, BASE_BEGIN);
-
-	VMUINT32 result;
-	VMUINT r;
+	if (mmio_patched(ofs, &val))
+		return val;
 
-	vm_file_read_opt(vram, ((VMUINT8*)&result), 4, &r);
-	return result;
+	return vram_load4(ofs);
 }
 
 static VMUINT16 load2(VMUINT32 ofs) {
 	last_rd_addr = ofs;
-	vm_file_seek_opt(vram, ofs, BASE_BEGIN);
-
-	VMUINT16 result;
-	VMUINT r;
-
-	vm_file_read_opt(vram, ((VMUINT8*)&result), 2, &r);
-	return result;
+	PERF_INC(perf.loads);
+	return vram_load2(ofs);
 }
 
 static VMUINT8 load1(VMUINT32 ofs) {
 	last_rd_addr = ofs;
-	vm_file_seek_opt(vram, ofs, BASE_BEGIN);
-
-	VMUINT8 result;
-	VMUINT r;
+	PERF_INC(perf.loads);
+	return vram_load1(ofs);
+}
 
-	vm_file_read_opt(vram, ((VMUINT8*)&result), 1, &r);
-	return result;
+// Aligned word for an AMO, one page lookup for both the read and the write
+static VMUINT32 *amo_ptr(VMUINT32 ofs) {
+	VMUINT32 val;
+	if (mmio_patched(ofs, &val))
+		return NULL; // Reads as the patch, see load4()
+	last_rd_addr = last_wr_addr = ofs;
+	PERF_INC(perf.loads);
+	PERF_INC(perf.stores);
+	jit_store_check(ofs);
+	return (VMUINT32*)vram_ptr_w(ofs);
 }
 
+#ifdef JIT_ENABLE
+// Memory bus for translated code. Stores skip the interpreter's store path,
+// so they check the decode cache here.
+static VMUINT32 jit_load1(VMUINT32 ofs) { return load1(ofs); }
+static VMUINT32 jit_load2(VMUINT32 ofs) { return load2(ofs); }
+static VMUINT32 jit_load4(VMUINT32 ofs) { return load4(ofs); }
+static void jit_store1(VMUINT32 ofs, VMUINT32 val) { MINIRV32_CODE_STORE(ofs); store1(ofs, val); }
+static void jit_store2(VMUINT32 ofs, VMUINT32 val) { MINIRV32_CODE_STORE(ofs); store2(ofs, val); }
+static void jit_store4(VMUINT32 ofs, VMUINT32 val) { MINIRV32_CODE_STORE(ofs); store4(ofs, val); }
+
+static const jit_bus_t jit_bus = { jit_load1, jit_load2, jit_load4, jit_store1, jit_store2, jit_store4 };
+#endif
+
 // System event handler
 void handle_sysevt(VMINT message, VMINT param) {
 	VMWCHAR sd_path[100];
 	VMWCHAR vram_path[100];
+	VMFILE base = -1;
+	VMFILE disk;
+	vram_img_t img;
+	int boot_img = 0;
 	unsigned char zero_array[1024] = {0};
 	switch (message) {
 	case VM_MSG_CREATE:
@@ -326,22 +610,87 @@ void handle_sysevt(VMINT message, VMINT param) {
 		// init code
 
 		if (message == VM_MSG_CREATE) {
+			// Overlay mode if there is a base image
+			vm_gb2312_to_ucs2(vram_path, 1000, VRAM_BASE_FILE);
+			base = vm_file_open(vram_path, MODE_READ, VM_TRUE);
+			boot_img = base >= 0 && vram_img_probe(base, &img);
+			if (base < 0) { // A boot image copied to VRAM_FILE is a base too, it can't be written in place
+				vm_gb2312_to_ucs2(vram_path, 1000, VRAM_FILE);
+				base = vm_file_open(vram_path, MODE_READ, VM_TRUE);
+				boot_img = base >= 0 && vram_img_probe(base, &img);
+				if (base >= 0 && !boot_img) {
+					vm_file_close(base);
+					base = -1;
+				}
+			}
+			if (boot_img)
+				RAM_SIZE = img.ram_size;
+			pvcon_init(RAM_SIZE, soc_dma_written);
+			vblk_init(RAM_SIZE, soc_dma_written);
+
 			// Convert file path to ucs2
-			vm_gb2312_to_ucs2(vram_path, 1000, VRAM_FILE);
+			vm_gb2312_to_ucs2(vram_path, 1000, base >= 0 ? VRAM_OVERLAY_FILE : VRAM_FILE);
 
 			// Open RAM file
 			vram = vm_file_open(vram_path, // Virtual ram file (you can change yourself)
 				MODE_APPEND,               // Open in append mode
 				VM_TRUE);                  // Open in binary mode
+			if (vram < 0 && base >= 0) // First run over this base
+				vram = vm_file_open(vram_path, MODE_CREATE_ALWAYS_WRITE, VM_TRUE);
+
+			// Disk image for the block device, optional
+			vm_gb2312_to_ucs2(vram_path, 1000, VBLK_FILE);
+			disk = vm_file_open(vram_path, MODE_APPEND, VM_TRUE);
+			if (disk >= 0) {
+				vblk_open(disk, 0);
+			} else {
+				disk = vm_file_open(vram_path, MODE_READ, VM_TRUE);
+				if (disk >= 0)
+					vblk_open(disk, 1);
+			}
+
+#ifdef JIT_ENABLE
+			// Before the page cache, which takes what's left of the heap
+			if (!jit_init(&jit_bus, RAM_SIZE))
+				console_str_in("No executable memory, JIT off\n");
+#endif
+
+			// Page cache in front of the RAM file
+			if (!vram_init(vram, RAM_SIZE, VRAM_PAGE_COUNT)) {
+				console_str_in("Not enough memory for RAM cache\n");
+				if (base >= 0)
+					vm_file_close(base);
+				vmstate = -2; // Every guest access would go through the page map, leave the core alone
+			} else {
+				if (base >= 0 && !vram_overlay_begin(base))
+					console_str_in("Not enough memory for the overlay index\n");
+				if (RESIDENT_RAM_MAX)
+					vram_init_resident(RESIDENT_RAM_MAX, RESIDENT_RAM_HIGH);
+			}
 
 			// Allocate space for core struct
-			core = (struct MiniRV32IMAState *)vm_calloc(sizeof(struct MiniRV32IMAState));
+			if (vmstate != -2) {
+				core = (struct MiniRV32IMAState *)vm_calloc(sizeof(struct MiniRV32IMAState));
+				if (core == NULL) {
+					console_str_in("Not enough memory for the core\n");
+					vmstate = -2;
+				}
+			}
 
 			// Setup core
-			core->pc = MINIRV32_RAM_IMAGE_OFFSET;
-			core->regs[10] = 0x00; //hart ID
-			core->regs[11] = RAM_SIZE - sizeof(struct MiniRV32IMAState) - DTB_SIZE + MINIRV32_RAM_IMAGE_OFFSET; // dtb_pa (Must be valid pointer) (Should be pointer to dtb)
-			core->extraflags |= 3; // Machine-mode.
+			if (vmstate != -2) {
+				core->pc = MINIRV32_RAM_IMAGE_OFFSET;
+				core->regs[10] = 0x00; //hart ID
+				if (boot_img) {
+					core->regs[11] = img.dtb_ofs; // dtb_pa, from the image header
+				} else {
+					core->regs[11] = RAM_SIZE - sizeof(struct MiniRV32IMAState) - DTB_SIZE; // dtb_pa (Must be valid pointer) (Should be pointer to dtb)
+					if (load4(core->regs[11]) != 0xedfe0dd0) // No FDT magic there, older image
+						core->regs[11] = RAM_SIZE - sizeof(struct MiniRV32IMAState) - DTB_SIZE_LEGACY;
+				}
+				core->regs[11] += MINIRV32_RAM_IMAGE_OFFSET;
+				core->extraflags |= 3; // Machine-mode.
+			}
 		}
 
 		if(soc_cycle_timer_id == -1)
@@ -367,12 +716,16 @@ void handle_sysevt(VMINT message, VMINT param) {
 		if(soc_cycle_timer_id != -1)
 			vm_delete_timer(soc_cycle_timer_id);
 		soc_cycle_timer_id = -1;
+		soc_sleeping = 0;
 		if(screen_timer_id!=-1)
 			vm_delete_timer(screen_timer_id);
 		screen_timer_id = -1;
 
-		// Commit data to file
-		//vm_file_commit(sd);
+		// Commit data to file, we may not get VM_MSG_QUIT
+		vram_flush();
+		if (vram >= 0)
+			vm_file_commit(vram);
+		vblk_flush();
 
 		// Close file handlers
 		//vm_file_close(sd);
@@ -389,14 +742,22 @@ void handle_sysevt(VMINT message, VMINT param) {
 		if(screen_timer_id!=-1)
 			vm_delete_timer(screen_timer_id);
 
-		// Close file handlers
+		// Write back cached pages and close file handlers
+		vram_flush();
+		vram_lazy_fill(vram_lazy_count); // Pages never touched since a snapshot resume, vram.bin must stand alone
+		vram_deinit();
 		vm_file_close(vram);
+		vblk_close();
+#ifdef JIT_ENABLE
+		jit_deinit();
+#endif
 		break;	
 	}
 }
 
 // Keyboard event handler
 void handle_keyevt(VMINT event, VMINT keycode) {
+	soc_last_input = vm_get_tick_count();
 #ifdef WIN32
 	if(keycode>=VM_KEY_NUM1&&keycode<=VM_KEY_NUM3)
 		keycode+=6;
@@ -404,12 +765,20 @@ void handle_keyevt(VMINT event, VMINT keycode) {
 		keycode-=6;
 #endif
 	t2input_handle_keyevt(event, keycode);
+
+	// Input for the guest, don't wait for the sleeping timer
+	if (soc_sleeping)
+		soc_schedule(0);
 }
 
 // Touch event handler
 void handle_penevt(VMINT event, VMINT x, VMINT y){
+	soc_last_input = vm_get_tick_count();
 	t2input_handle_penevt(event, x, y);
 	draw();
+
+	if (soc_sleeping)
+		soc_schedule(0);
 }
 
 // mini-rv32ima exception handlers
@@ -424,35 +793,102 @@ static VMUINT32 HandleException(VMUINT32 ir, VMUINT32 code)
 	return code;
 }
 
-static VMUINT32 HandleControlStore(VMUINT32 addy, VMUINT32 val)
-{
-	if (addy == 0x10000000) // UART 8250 / 16550 Data Buffer
-	{
-		char out[8];
-		sprintf(out, "%c", val);
-		console_str_in(out);
-	}
+// MMIO devices. Anything that may change an interrupt line updates MEIP right away.
+
+static VMUINT32 soc_uart_load(VMUINT32 ofs) { // UART 16550
+	VMUINT32 val = uart_load(ofs);
+	soc_irq_update();
+	return val;
+}
+
+static int soc_uart_store(VMUINT32 ofs, VMUINT32 val) {
+	uart_store(ofs, val);
+	soc_irq_update();
 	return 0;
 }
 
+static int soc_pvcon_store(VMUINT32 ofs, VMUINT32 val) { // Console
+	pvcon_store(ofs, val);
+	soc_irq_update();
+	return 0;
+}
 
-static VMUINT32 HandleControlLoad(VMUINT32 addy)
-{
-	// Emulating a 8250 / 16550 UART
+static int soc_vblk_store(VMUINT32 ofs, VMUINT32 val) { // Block device
+	vblk_store(ofs, val);
+	soc_irq_update();
+	return 0;
+}
 
-	if (addy == 0x10000005) {
-		return 0x60 | (!fifo_is_empty(serial_in));
-	}
+// Guest RAM the block device or the console wrote, code there is stale
+static void soc_dma_written(VMUINT32 ofs, VMUINT32 len) {
+#ifdef JIT_ENABLE
+	VMUINT32 p;
+	for (p = ofs & ~0xfff; p < ofs + len; p += 0x1000)
+		jit_store_check(p);
+#endif
+#ifdef MINIRV32_DECODE_CACHE
+	MiniRV32IMAInvalidateCode(ofs, len);
+#endif
+}
 
-	else if (addy == 0x10000000 && (!fifo_is_empty(serial_in))) {
-		int ret;
-		fifo_get(serial_in, &ret);
-		return ret;
-	}
+static VMUINT32 soc_plic_load(VMUINT32 ofs) {
+	VMUINT32 val = plic_load(ofs);
+	soc_irq_update(); // A claim takes the source off MEIP
+	return val;
+}
+
+static int soc_plic_store(VMUINT32 ofs, VMUINT32 val) {
+	plic_store(ofs, val);
+	soc_irq_update();
+	return 0;
+}
 
+// https://chromitem-soc.readthedocs.io/en/latest/clint.html, the timer lives in the core state
+static VMUINT32 soc_clint_load(VMUINT32 ofs) {
+	if (ofs == 0xbffc)
+		return core->timerh;
+	if (ofs == 0xbff8)
+		return core->timerl;
 	return 0;
 }
 
+static int soc_clint_store(VMUINT32 ofs, VMUINT32 val) {
+	if (ofs == 0x4004)
+		core->timermatchh = val;
+	else if (ofs == 0x4000)
+		core->timermatchl = val;
+	return 0;
+}
+
+// Reboot, poweroff etc.: leaves the core's step with the value written, see socRun()
+static int soc_syscon_store(VMUINT32 ofs, VMUINT32 val) {
+	return ofs == 0;
+}
+
+static void soc_mmio_init(void) {
+	mmio_register(UART_BASE, UART_SIZE, "uart", soc_uart_load, soc_uart_store);
+	mmio_register(PVCON_BASE, PVCON_SIZE, "pvcon", pvcon_load, soc_pvcon_store);
+	mmio_register(VBLK_BASE, VBLK_SIZE, "vblk", vblk_load, soc_vblk_store);
+	mmio_register(PLIC_BASE, PLIC_SIZE, "plic", soc_plic_load, soc_plic_store);
+	mmio_register(CLINT_BASE, CLINT_SIZE, "clint", soc_clint_load, soc_clint_store);
+	mmio_register(SYSCON_BASE, SYSCON_SIZE, "syscon", NULL, soc_syscon_store);
+
+	// Boot code fix-up, this word is read as bge a3, a4, -8 whatever is in RAM
+	mmio_patch_add(0xB8, 0xFEE6DCE3);
+}
+
+// Drive MEIP from the PLIC, after anything that may change an interrupt line
+static void soc_irq_update(void)
+{
+	plic_set_irq(UART_IRQ, uart_irq());
+	plic_set_irq(PVCON_IRQ, pvcon_irq());
+	plic_set_irq(VBLK_IRQ, vblk_irq());
+	if (plic_meip())
+		core->mip |= 1 << 11;
+	else
+		core->mip &= ~(1 << 11);
+}
+
 static void HandleOtherCSRWrite(VMUINT8* image, VMUINT16 csrno, VMUINT32 value)
 {
 	if (csrno == 0x136)
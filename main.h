@@ -5,8 +5,6 @@
 #include "vmchset.h"
 #include "vmstdlib.h"
 
-#include "fifo.h" // fifo implementation
-
 const unsigned short tr_color = VM_COLOR_888_TO_565(0, 255, 255);
 
 #ifdef WIN32
@@ -19,6 +19,23 @@
 		* There is free MMIO from there to 0x12000000.
 		* You can put things like a UART, or whatever there.
 		* Feel free to override any of the functionality with macros.
+		* #define MINIRV32_DECODE_CACHE to keep predecoded instructions in a
+		  direct-mapped cache keyed by PC.  Stores to RAM that held decoded
+		  code and fence.i invalidate it.  If you write guest RAM behind the
+		  core's back, call MiniRV32IMAInvalidateCode().
+		* #define MINIRV32_THREADED_DISPATCH to dispatch opcodes through a table
+		  of GCC computed goto labels instead of a switch.  Needs GCC or clang,
+		  other compilers silently get the switch.  MINIRV32_DISPATCH_NAME
+		  tells which one was built, for comparing speeds.
+		* #define MINIRV32_BLOCK_EXEC( pc, budget, ran ) to run translated code.
+		  It's tried before each instruction; if it runs `ran` (at most
+		  budget) instructions it must leave the next PC in pc.
+		* #define MINIRV32_RVC for the C extension.  Compressed instructions
+		  are expanded to their 32-bit form when decoded, so they cost the
+		  same as the rest once in the decode cache.  Macros that leave the
+		  step early find the length of the current instruction in ilen.
+		* #define MINIRV32_TRAP( trap ) to see every trap and interrupt as it
+		  is taken, before the CSRs are set up for it.
 */
 
 #ifndef MINIRV32WARN
@@ -45,6 +62,9 @@
 #define MINIRV32_HANDLE_MEM_LOAD_CONTROL(...);
 #endif
 
+// Define MINIRV32_CUSTOM_MMIO to hand the whole MMIO window to the two macros above,
+// CLINT and SYSCON included. The store one then has to leave the step for SYSCON itself.
+
 #ifndef MINIRV32_OTHERCSR_WRITE
 #define MINIRV32_OTHERCSR_WRITE(...);
 #endif
@@ -53,6 +73,10 @@
 #define MINIRV32_OTHERCSR_READ(...);
 #endif
 
+#ifndef MINIRV32_TRAP
+#define MINIRV32_TRAP(...);
+#endif
+
 #ifndef MINIRV32_CUSTOM_MEMORY_BUS
 #define MINIRV32_STORE4( ofs, val ) *(uint32_t*)(image + ofs) = val
 #define MINIRV32_STORE2( ofs, val ) *(uint16_t*)(image + ofs) = val
@@ -62,8 +86,12 @@
 #define MINIRV32_LOAD1( ofs ) *(uint8_t*)(image + ofs)
 #define MINIRV32_LOAD2_SIGNED( ofs ) *(int16_t*)(image + ofs)
 #define MINIRV32_LOAD1_SIGNED( ofs ) *(int8_t*)(image + ofs)
+#define MINIRV32_AMO_PTR( ofs ) (uint32_t*)(image + ofs)
 #endif
 
+// A custom bus may define MINIRV32_AMO_PTR( ofs ) too: a writable pointer to the aligned RAM word at ofs,
+// or NULL. AMOs then modify the word in place instead of going through a load and a store.
+
 // As a note: We quouple-ify these, because in HLSL, we will be operating with
 // uint4's.  We are going to uint4 data to/from system RAM.
 //
@@ -98,6 +126,50 @@ struct MiniRV32IMAState
 	uint32_t extraflags;
 };
 
+// One decoded instruction.
+struct MiniRV32IMAInsn
+{
+	uint32_t pc;  // PC it was decoded from; with MINIRV32_DECODE_CACHE, 0 marks an empty entry.
+	uint32_t ir;
+	int32_t imm;  // Sign-extended immediate of the instruction's format.
+	uint8_t op;   // Major opcode (ir & 0x7f).
+	uint8_t rd;   // 0 if the instruction never writes a register.
+	uint8_t rs1;
+	uint8_t rs2;
+};
+
+#ifdef MINIRV32_RVC
+#define MINIRV32_IALIGN_SHIFT 1
+#define MINIRV32_MISA 0x40401105 // XLEN=32, IMAC+X
+#define MINIRV32_INSN_LEN( ir ) (2 + ((ir) & 2)) // An expanded compressed instruction has bit 1 cleared
+#else
+#define MINIRV32_IALIGN_SHIFT 2
+#define MINIRV32_MISA 0x40401101 // XLEN=32, IMA+X
+#define MINIRV32_INSN_LEN( ir ) 4
+#endif
+
+#ifdef MINIRV32_DECODE_CACHE
+#ifndef MINIRV32_DECODE_CACHE_BITS
+#define MINIRV32_DECODE_CACHE_BITS 11 // 2048 entries
+#endif
+#ifndef MINIRV32_DECODE_CACHE_MAX_RAM
+#define MINIRV32_DECODE_CACHE_MAX_RAM (64*1024*1024) // RAM covered by the code page bitmap.
+#endif
+#define MINIRV32_DECODE_PAGE_SHIFT 12
+MINIRV32_DECORATE void MiniRV32IMAInvalidateCode(uint32_t ofs, uint32_t len);
+MINIRV32_DECORATE void MiniRV32IMAFlushDecodeCache(void);
+#endif
+
+#if defined(MINIRV32_THREADED_DISPATCH) && !defined(__GNUC__)
+#undef MINIRV32_THREADED_DISPATCH
+#endif
+
+#ifdef MINIRV32_THREADED_DISPATCH
+#define MINIRV32_DISPATCH_NAME "threaded"
+#else
+#define MINIRV32_DISPATCH_NAME "switch"
+#endif
+
 #ifndef MINIRV32_STEPPROTO
 MINIRV32_DECORATE int32_t MiniRV32IMAStep(struct MiniRV32IMAState* state, uint8_t* image, uint32_t vProcAddress, uint32_t elapsedUs, int count);
 #endif
@@ -111,12 +183,254 @@ MINIRV32_DECORATE int32_t MiniRV32IMAStep(struct MiniRV32IMAState* state, uint8_
 #define REGSET( x, val ) { state->regs[x] = val; }
 #endif
 
+#ifdef MINIRV32_RVC
+// Instruction formats, for building the 32-bit equivalent of a compressed instruction.
+#define MINIRV32_I( op, f3, rd, rs1, imm ) ((((uint32_t)(imm) & 0xfff) << 20) | ((rs1) << 15) | ((f3) << 12) | ((rd) << 7) | (op))
+#define MINIRV32_R( op, f3, f7, rd, rs1, rs2 ) (((f7) << 25) | ((rs2) << 20) | ((rs1) << 15) | ((f3) << 12) | ((rd) << 7) | (op))
+#define MINIRV32_S( f3, rs1, rs2, imm ) ((((imm) >> 5) << 25) | ((rs2) << 20) | ((rs1) << 15) | ((f3) << 12) | (((imm) & 0x1f) << 7) | 0x23)
+#define MINIRV32_B( f3, rs1, imm ) (((((uint32_t)(imm) >> 12) & 1) << 31) | ((((uint32_t)(imm) >> 5) & 0x3f) << 25) | ((rs1) << 15) | ((f3) << 12) | ((((uint32_t)(imm) >> 1) & 0xf) << 8) | ((((uint32_t)(imm) >> 11) & 1) << 7) | 0x63)
+#define MINIRV32_J( rd, imm ) (((((uint32_t)(imm) >> 20) & 1) << 31) | ((((uint32_t)(imm) >> 1) & 0x3ff) << 21) | ((((uint32_t)(imm) >> 11) & 1) << 20) | ((uint32_t)(imm) & 0xff000) | ((rd) << 7) | 0x6f)
+
+// RV32C to RV32I, 0 for anything illegal (F/D loads and stores too, there's no FPU).
+static inline uint32_t MiniRV32IMAExpand(uint32_t c)
+{
+	uint32_t rd = (c >> 7) & 0x1f;      // rd/rs1 of the CR, CI and CSS formats
+	uint32_t rs2 = (c >> 2) & 0x1f;
+	uint32_t rdp = ((c >> 2) & 7) + 8;  // rd'/rs2' of the CIW, CL and CS formats
+	uint32_t rs1p = ((c >> 7) & 7) + 8; // rs1'/rd'
+	int32_t imm6 = (int32_t)((((c >> 2) & 0x1f) | ((c >> 7) & 0x20)) << 26) >> 26; // CI sign-extended imm[5:0]
+	uint32_t uimm;
+	int32_t imm;
+
+	switch (((c & 3) << 3) | (c >> 13))
+	{
+	case 0x00: // C.ADDI4SPN
+		uimm = ((c >> 7) & 0x30) | ((c >> 1) & 0x3c0) | ((c >> 4) & 4) | ((c >> 2) & 8);
+		return uimm ? MINIRV32_I(0x13, 0, rdp, 2, uimm) : 0;
+	case 0x02: // C.LW
+		uimm = ((c >> 7) & 0x38) | ((c >> 4) & 4) | ((c << 1) & 0x40);
+		return MINIRV32_I(0x03, 2, rdp, rs1p, uimm);
+	case 0x06: // C.SW
+		uimm = ((c >> 7) & 0x38) | ((c >> 4) & 4) | ((c << 1) & 0x40);
+		return MINIRV32_S(2, rs1p, rdp, uimm);
+	case 0x08: // C.ADDI, C.NOP
+		return MINIRV32_I(0x13, 0, rd, rd, imm6);
+	case 0x09: // C.JAL
+	case 0x0d: // C.J
+		imm = ((c >> 1) & 0x800) | ((c >> 7) & 0x10) | ((c >> 1) & 0x300) | ((c << 2) & 0x400) |
+			((c >> 1) & 0x40) | ((c << 1) & 0x80) | ((c >> 2) & 0xe) | ((c << 3) & 0x20);
+		imm = (imm << 20) >> 20;
+		return MINIRV32_J((c >> 13) == 1 ? 1 : 0, imm);
+	case 0x0a: // C.LI
+		return MINIRV32_I(0x13, 0, rd, 0, imm6);
+	case 0x0b:
+		if (rd == 2) // C.ADDI16SP
+		{
+			imm = ((c >> 3) & 0x200) | ((c >> 2) & 0x10) | ((c << 1) & 0x40) | ((c << 4) & 0x180) | ((c << 3) & 0x20);
+			imm = (imm << 22) >> 22;
+			return imm ? MINIRV32_I(0x13, 0, 2, 2, imm) : 0;
+		}
+		return imm6 ? (((uint32_t)imm6 << 12) | (rd << 7) | 0x37) : 0; // C.LUI
+	case 0x0c:
+		switch ((c >> 10) & 3)
+		{
+		case 0: return (c & 0x1000) ? 0 : MINIRV32_I(0x13, 5, rs1p, rs1p, rs2);         // C.SRLI
+		case 1: return (c & 0x1000) ? 0 : MINIRV32_I(0x13, 5, rs1p, rs1p, rs2 | 0x400); // C.SRAI
+		case 2: return MINIRV32_I(0x13, 7, rs1p, rs1p, imm6);                            // C.ANDI
+		}
+		if (c & 0x1000)
+			return 0; // C.SUBW, C.ADDW are RV64
+		switch ((c >> 5) & 3)
+		{
+		case 0: return MINIRV32_R(0x33, 0, 0x20, rs1p, rs1p, rdp); // C.SUB
+		case 1: return MINIRV32_R(0x33, 4, 0, rs1p, rs1p, rdp);    // C.XOR
+		case 2: return MINIRV32_R(0x33, 6, 0, rs1p, rs1p, rdp);    // C.OR
+		default: return MINIRV32_R(0x33, 7, 0, rs1p, rs1p, rdp);   // C.AND
+		}
+	case 0x0e: // C.BEQZ
+	case 0x0f: // C.BNEZ
+		imm = ((c >> 4) & 0x100) | ((c >> 7) & 0x18) | ((c << 1) & 0xc0) | ((c >> 2) & 6) | ((c << 3) & 0x20);
+		imm = (imm << 23) >> 23;
+		return MINIRV32_B((c >> 13) & 1, rs1p, imm);
+	case 0x10: // C.SLLI
+		return (c & 0x1000) ? 0 : MINIRV32_I(0x13, 1, rd, rd, rs2);
+	case 0x12: // C.LWSP
+		uimm = ((c >> 7) & 0x20) | ((c >> 2) & 0x1c) | ((c << 4) & 0xc0);
+		return rd ? MINIRV32_I(0x03, 2, rd, 2, uimm) : 0;
+	case 0x14:
+		if (!(c & 0x1000))
+		{
+			if (rs2) return MINIRV32_R(0x33, 0, 0, rd, 0, rs2); // C.MV
+			return rd ? MINIRV32_I(0x67, 0, 0, rd, 0) : 0;      // C.JR
+		}
+		if (rs2) return MINIRV32_R(0x33, 0, 0, rd, rd, rs2);    // C.ADD
+		return rd ? MINIRV32_I(0x67, 0, 1, rd, 0) : 0x00100073; // C.JALR, C.EBREAK
+	case 0x16: // C.SWSP
+		uimm = ((c >> 7) & 0x3c) | ((c >> 1) & 0xc0);
+		return MINIRV32_S(2, 2, rs2, uimm);
+	}
+	return 0;
+}
+#endif
+
+static inline void MiniRV32IMADecode(struct MiniRV32IMAInsn* d, uint32_t pc, uint32_t ir)
+{
+#ifdef MINIRV32_RVC
+	uint32_t compressed = (ir & 3) != 3;
+	if (compressed)
+		ir = MiniRV32IMAExpand(ir & 0xffff);
+#endif
+	d->pc = pc;
+	d->ir = ir;
+	d->op = ir & 0x7f;
+	d->rd = (ir >> 7) & 0x1f;
+	d->rs1 = (ir >> 15) & 0x1f;
+	d->rs2 = (ir >> 20) & 0x1f;
+
+	switch (d->op)
+	{
+	case 0x37: // LUI (0b0110111)
+	case 0x17: // AUIPC (0b0010111)
+		d->imm = ir & 0xfffff000;
+		break;
+	case 0x6F: // JAL (0b1101111)
+	{
+		int32_t reladdy = ((ir & 0x80000000) >> 11) | ((ir & 0x7fe00000) >> 20) | ((ir & 0x00100000) >> 9) | ((ir & 0x000ff000));
+		if (reladdy & 0x00100000) reladdy |= 0xffe00000; // Sign extension.
+		d->imm = reladdy;
+		break;
+	}
+	case 0x63: // Branch (0b1100011)
+	{
+		uint32_t immm4 = ((ir & 0xf00) >> 7) | ((ir & 0x7e000000) >> 20) | ((ir & 0x80) << 4) | ((ir >> 31) << 12);
+		if (immm4 & 0x1000) immm4 |= 0xffffe000;
+		d->imm = immm4;
+		d->rd = 0;
+		break;
+	}
+	case 0x23: // Store 0b0100011
+	{
+		uint32_t addy = ((ir >> 7) & 0x1f) | ((ir & 0xfe000000) >> 20);
+		if (addy & 0x800) addy |= 0xfffff000;
+		d->imm = addy;
+		d->rd = 0;
+		break;
+	}
+	case 0x0f: // 0b0001111
+		d->imm = 0;
+		d->rd = 0;
+		break;
+	default: // I-type: JALR, Load, Op-immediate, SYSTEM.  Op ignores it.
+	{
+		uint32_t imm = ir >> 20;
+		d->imm = imm | ((imm & 0x800) ? 0xfffff000 : 0);
+		break;
+	}
+	}
+#ifdef MINIRV32_RVC
+	if (compressed)
+		d->ir &= ~2; // See MINIRV32_INSN_LEN
+#endif
+}
+
+// Instruction at RAM offset ofs, only the low half matters if it's compressed.
+static inline uint32_t MiniRV32IMAFetch(uint8_t* image, uint32_t ofs)
+{
+	(void)image; // Only used by the default memory bus
+#ifdef MINIRV32_RVC
+	if (ofs & 2) // Not word aligned, the upper half may be in the next page
+	{
+		uint32_t ir = MINIRV32_LOAD2(ofs);
+		if ((ir & 3) != 3)
+			return ir;
+		if (ofs + 2 >= MINI_RV32_RAM_SIZE)
+			return 0; // Runs off the end of RAM, decodes as illegal
+		return ir | ((uint32_t)MINIRV32_LOAD2(ofs + 2) << 16);
+	}
+#endif
+	return MINIRV32_LOAD4(ofs);
+}
+
+#ifdef MINIRV32_DECODE_CACHE
+static struct MiniRV32IMAInsn minirv32_decode_cache[1 << MINIRV32_DECODE_CACHE_BITS];
+static uint32_t minirv32_code_pages[(MINIRV32_DECODE_CACHE_MAX_RAM >> MINIRV32_DECODE_PAGE_SHIFT) / 32]; // Pages that have entries in the cache.
+
+#define MINIRV32_CODE_PAGE_WORD( ofs ) minirv32_code_pages[((ofs) >> (MINIRV32_DECODE_PAGE_SHIFT + 5)) & (sizeof(minirv32_code_pages) / 4 - 1)]
+#define MINIRV32_CODE_PAGE_BIT( ofs ) (1u << (((ofs) >> MINIRV32_DECODE_PAGE_SHIFT) & 31))
+// Cache slot of the instruction at ofs.  Word aligned ones map as without RVC, the
+// ones in between to the other half of the cache, so neighbours don't collide.
+#define MINIRV32_DECODE_SLOT( ofs ) ((((ofs) >> 2) ^ (((ofs) & 2) << (MINIRV32_DECODE_CACHE_BITS - 2))) & ((1 << MINIRV32_DECODE_CACHE_BITS) - 1))
+
+// Call before a store of up to 4 bytes to RAM offset ofs.
+#define MINIRV32_CODE_STORE( ofs ) if ((MINIRV32_CODE_PAGE_WORD(ofs) & MINIRV32_CODE_PAGE_BIT(ofs)) || (MINIRV32_CODE_PAGE_WORD((ofs) + 3) & MINIRV32_CODE_PAGE_BIT((ofs) + 3))) MiniRV32IMAInvalidateCode(ofs, 4);
+
+MINIRV32_DECORATE void MiniRV32IMAFlushDecodeCache(void)
+{
+	memset(minirv32_decode_cache, 0, sizeof(minirv32_decode_cache));
+	memset(minirv32_code_pages, 0, sizeof(minirv32_code_pages));
+}
+
+// Drop decoded instructions in the pages covering RAM offsets [ofs, ofs+len).
+MINIRV32_DECORATE void MiniRV32IMAInvalidateCode(uint32_t ofs, uint32_t len)
+{
+	uint32_t page = ofs >> MINIRV32_DECODE_PAGE_SHIFT;
+	uint32_t last = (ofs + len - 1) >> MINIRV32_DECODE_PAGE_SHIFT;
+	for (; page <= last; page++)
+	{
+		uint32_t pofs = page << MINIRV32_DECODE_PAGE_SHIFT;
+		if (!(MINIRV32_CODE_PAGE_WORD(pofs) & MINIRV32_CODE_PAGE_BIT(pofs)))
+			continue;
+		MINIRV32_CODE_PAGE_WORD(pofs) &= ~MINIRV32_CODE_PAGE_BIT(pofs);
+
+		// Only the slots the page's words map to can hold its instructions.
+		uint32_t n = 1 << (MINIRV32_DECODE_PAGE_SHIFT - MINIRV32_IALIGN_SHIFT);
+		if (n > (1 << MINIRV32_DECODE_CACHE_BITS)) n = 1 << MINIRV32_DECODE_CACHE_BITS;
+		uint32_t i;
+		for (i = 0; i < n; i++)
+		{
+			struct MiniRV32IMAInsn* d = &minirv32_decode_cache[MINIRV32_DECODE_SLOT(pofs + (i << MINIRV32_IALIGN_SHIFT))];
+			if (d->pc && ((d->pc - MINIRV32_RAM_IMAGE_OFFSET) >> MINIRV32_DECODE_PAGE_SHIFT) == page)
+				d->pc = 0;
+		}
+#ifdef MINIRV32_RVC
+		// A 32-bit instruction may start in the page before
+		if (pofs)
+		{
+			struct MiniRV32IMAInsn* d = &minirv32_decode_cache[MINIRV32_DECODE_SLOT(pofs - 2)];
+			if (d->pc == pofs - 2 + MINIRV32_RAM_IMAGE_OFFSET)
+				d->pc = 0;
+		}
+#endif
+	}
+}
+#else
+#define MINIRV32_CODE_STORE( ofs )
+#endif
+
+// Opcode dispatch.  The threaded version jumps straight to the handler of
+// the 7-bit opcode, no range check.  The do/while(0) keeps `break` leaving
+// the handler, like it leaves a case.
+#ifdef MINIRV32_THREADED_DISPATCH
+#define MINIRV32_DISPATCH( op ) do { goto *minirv32_dispatch[(op) & 0x7f];
+#define MINIRV32_OP( name, op ) op_##name:
+#define MINIRV32_OP_DEFAULT op_default:
+#define MINIRV32_DISPATCH_END } while (0);
+#else
+#define MINIRV32_DISPATCH( op ) switch (op) {
+#define MINIRV32_OP( name, op ) case op:
+#define MINIRV32_OP_DEFAULT default:
+#define MINIRV32_DISPATCH_END }
+#endif
+
 #ifndef MINIRV32_STEPPROTO
 MINIRV32_DECORATE int32_t MiniRV32IMAStep(struct MiniRV32IMAState* state, uint8_t* image, uint32_t vProcAddress, uint32_t elapsedUs, int count)
 #else
 MINIRV32_STEPPROTO
 #endif
 {
+#ifndef MINIRV32_STEPPROTO
+	(void)vProcAddress; // Kept for the upstream signature
+#endif
 	uint32_t new_timer = CSR(timerl) + elapsedUs;
 	if (new_timer < CSR(timerl)) CSR(timerh)++;
 	CSR(timerl) = new_timer;
@@ -130,25 +444,55 @@ MINIRV32_STEPPROTO
 	else
 		CSR(mip) &= ~(1 << 7);
 
+	// External interrupt, MEIP is driven by the host (PLIC)
+	if (CSR(mip) & CSR(mie) & (1 << 11))
+		CSR(extraflags) &= ~4; // Clear WFI
+
 	// If WFI, don't run processor.
 	if (CSR(extraflags) & 4)
 		return 1;
 
+#ifdef MINIRV32_THREADED_DISPATCH
+	static const void* const minirv32_dispatch[128] = {
+		// In opcode order, every entry once: ranges overlapped by later designators trip -Woverride-init
+		[0x00 ... 0x02] = &&op_default, [0x03] = &&op_load,
+		[0x04 ... 0x0e] = &&op_default, [0x0f] = &&op_fence,
+		[0x10 ... 0x12] = &&op_default, [0x13] = &&op_opimm,
+		[0x14 ... 0x16] = &&op_default, [0x17] = &&op_auipc,
+		[0x18 ... 0x22] = &&op_default, [0x23] = &&op_store,
+		[0x24 ... 0x2e] = &&op_default, [0x2f] = &&op_amo,
+		[0x30 ... 0x32] = &&op_default, [0x33] = &&op_op,
+		[0x34 ... 0x36] = &&op_default, [0x37] = &&op_lui,
+		[0x38 ... 0x62] = &&op_default, [0x63] = &&op_branch,
+		[0x64 ... 0x66] = &&op_default, [0x67] = &&op_jalr,
+		[0x68 ... 0x6e] = &&op_default, [0x6f] = &&op_jal,
+		[0x70 ... 0x72] = &&op_default, [0x73] = &&op_system,
+		[0x74 ... 0x7f] = &&op_default,
+	};
+#endif
+
 	uint32_t trap = 0;
 	uint32_t rval = 0;
 	uint32_t pc = CSR(pc);
 	uint32_t cycle = CSR(cyclel);
 
-	if ((CSR(mip) & (1 << 7)) && (CSR(mie) & (1 << 7) /*mtie*/) && (CSR(mstatus) & 0x8 /*mie*/))
+	if ((CSR(mip) & (1 << 11)) && (CSR(mie) & (1 << 11) /*meie*/) && (CSR(mstatus) & 0x8 /*mie*/))
+	{
+		// External interrupt, takes priority over the timer.
+		trap = 0x8000000b;
+		pc -= 4;
+	}
+	else if ((CSR(mip) & (1 << 7)) && (CSR(mie) & (1 << 7) /*mtie*/) && (CSR(mstatus) & 0x8 /*mie*/))
 	{
 		// Timer interrupt.
 		trap = 0x80000007;
 		pc -= 4;
 	}
-	else // No timer interrupt?  Execute a bunch of instructions.
+	else // No interrupt?  Execute a bunch of instructions.
 		for (int icount = 0; icount < count; icount++)
 		{
 			uint32_t ir = 0;
+			uint32_t ilen = 4;
 			rval = 0;
 			cycle++;
 			uint32_t ofs_pc = pc - MINIRV32_RAM_IMAGE_OFFSET;
@@ -158,48 +502,65 @@ MINIRV32_STEPPROTO
 				trap = 1 + 1;  // Handle access violation on instruction read.
 				break;
 			}
-			else if (ofs_pc & 3)
+			else if (ofs_pc & ((1 << MINIRV32_IALIGN_SHIFT) - 1))
 			{
 				trap = 1 + 0;  //Handle PC-misaligned access
 				break;
 			}
 			else
 			{
-				ir = MINIRV32_LOAD4(ofs_pc);
-				uint32_t rdid = (ir >> 7) & 0x1f;
-
-				switch (ir & 0x7f)
+#ifdef MINIRV32_BLOCK_EXEC
+				uint32_t ran = 0;
+				MINIRV32_BLOCK_EXEC(pc, count - icount, ran);
+				if (ran)
 				{
-				case 0x37: // LUI (0b0110111)
-					rval = (ir & 0xfffff000);
+					cycle += ran - 1;
+					icount += ran - 1;
+					continue;
+				}
+#endif
+#ifdef MINIRV32_DECODE_CACHE
+				struct MiniRV32IMAInsn* d = &minirv32_decode_cache[MINIRV32_DECODE_SLOT(ofs_pc)];
+				if (d->pc != pc)
+				{
+					MiniRV32IMADecode(d, pc, MiniRV32IMAFetch(image, ofs_pc));
+					MINIRV32_CODE_PAGE_WORD(ofs_pc) |= MINIRV32_CODE_PAGE_BIT(ofs_pc);
+#ifdef MINIRV32_RVC
+					MINIRV32_CODE_PAGE_WORD(ofs_pc + 2) |= MINIRV32_CODE_PAGE_BIT(ofs_pc + 2); // It may end in the next page
+#endif
+				}
+#else
+				struct MiniRV32IMAInsn dl, *d = &dl;
+				MiniRV32IMADecode(d, pc, MiniRV32IMAFetch(image, ofs_pc));
+#endif
+				ir = d->ir;
+				ilen = MINIRV32_INSN_LEN(ir);
+				uint32_t rdid = d->rd;
+
+				MINIRV32_DISPATCH(d->op)
+				MINIRV32_OP(lui, 0x37) // LUI (0b0110111)
+					rval = d->imm;
 					break;
-				case 0x17: // AUIPC (0b0010111)
-					rval = pc + (ir & 0xfffff000);
+				MINIRV32_OP(auipc, 0x17) // AUIPC (0b0010111)
+					rval = pc + d->imm;
 					break;
-				case 0x6F: // JAL (0b1101111)
+				MINIRV32_OP(jal, 0x6F) // JAL (0b1101111)
 				{
-					int32_t reladdy = ((ir & 0x80000000) >> 11) | ((ir & 0x7fe00000) >> 20) | ((ir & 0x00100000) >> 9) | ((ir & 0x000ff000));
-					if (reladdy & 0x00100000) reladdy |= 0xffe00000; // Sign extension.
-					rval = pc + 4;
-					pc = pc + reladdy - 4;
+					rval = pc + ilen;
+					pc = pc + d->imm - ilen;
 					break;
 				}
-				case 0x67: // JALR (0b1100111)
+				MINIRV32_OP(jalr, 0x67) // JALR (0b1100111)
 				{
-					uint32_t imm = ir >> 20;
-					int32_t imm_se = imm | ((imm & 0x800) ? 0xfffff000 : 0);
-					rval = pc + 4;
-					pc = ((REG((ir >> 15) & 0x1f) + imm_se) & ~1) - 4;
+					rval = pc + ilen;
+					pc = ((REG(d->rs1) + d->imm) & ~1) - ilen;
 					break;
 				}
-				case 0x63: // Branch (0b1100011)
+				MINIRV32_OP(branch, 0x63) // Branch (0b1100011)
 				{
-					uint32_t immm4 = ((ir & 0xf00) >> 7) | ((ir & 0x7e000000) >> 20) | ((ir & 0x80) << 4) | ((ir >> 31) << 12);
-					if (immm4 & 0x1000) immm4 |= 0xffffe000;
-					int32_t rs1 = REG((ir >> 15) & 0x1f);
-					int32_t rs2 = REG((ir >> 20) & 0x1f);
-					immm4 = pc + immm4 - 4;
-					rdid = 0;
+					int32_t rs1 = REG(d->rs1);
+					int32_t rs2 = REG(d->rs2);
+					uint32_t immm4 = pc + d->imm - ilen;
 					switch ((ir >> 12) & 0x7)
 					{
 						// BEQ, BNE, BLT, BGE, BLTU, BGEU
@@ -213,12 +574,9 @@ MINIRV32_STEPPROTO
 					}
 					break;
 				}
-				case 0x03: // Load (0b0000011)
+				MINIRV32_OP(load, 0x03) // Load (0b0000011)
 				{
-					uint32_t rs1 = REG((ir >> 15) & 0x1f);
-					uint32_t imm = ir >> 20;
-					int32_t imm_se = imm | ((imm & 0x800) ? 0xfffff000 : 0);
-					uint32_t rsval = rs1 + imm_se;
+					uint32_t rsval = REG(d->rs1) + d->imm;
 
 					rsval -= MINIRV32_RAM_IMAGE_OFFSET;
 					if (rsval >= MINI_RV32_RAM_SIZE - 3)
@@ -226,12 +584,16 @@ MINIRV32_STEPPROTO
 						rsval += MINIRV32_RAM_IMAGE_OFFSET;
 						if (rsval >= 0x10000000 && rsval < 0x12000000)  // UART, CLNT
 						{
+#ifdef MINIRV32_CUSTOM_MMIO
+							MINIRV32_HANDLE_MEM_LOAD_CONTROL(rsval, rval);
+#else
 							if (rsval == 0x1100bffc) // https://chromitem-soc.readthedocs.io/en/latest/clint.html
 								rval = CSR(timerh);
 							else if (rsval == 0x1100bff8)
 								rval = CSR(timerl);
 							else
 								MINIRV32_HANDLE_MEM_LOAD_CONTROL(rsval, rval);
+#endif
 						}
 						else
 						{
@@ -254,14 +616,10 @@ MINIRV32_STEPPROTO
 					}
 					break;
 				}
-				case 0x23: // Store 0b0100011
+				MINIRV32_OP(store, 0x23) // Store 0b0100011
 				{
-					uint32_t rs1 = REG((ir >> 15) & 0x1f);
-					uint32_t rs2 = REG((ir >> 20) & 0x1f);
-					uint32_t addy = ((ir >> 7) & 0x1f) | ((ir & 0xfe000000) >> 20);
-					if (addy & 0x800) addy |= 0xfffff000;
-					addy += rs1 - MINIRV32_RAM_IMAGE_OFFSET;
-					rdid = 0;
+					uint32_t rs2 = REG(d->rs2);
+					uint32_t addy = REG(d->rs1) + d->imm - MINIRV32_RAM_IMAGE_OFFSET;
 
 					if (addy >= MINI_RV32_RAM_SIZE - 3)
 					{
@@ -269,17 +627,21 @@ MINIRV32_STEPPROTO
 						if (addy >= 0x10000000 && addy < 0x12000000)
 						{
 							// Should be stuff like SYSCON, 8250, CLNT
+#ifdef MINIRV32_CUSTOM_MMIO
+							MINIRV32_HANDLE_MEM_STORE_CONTROL(addy, rs2);
+#else
 							if (addy == 0x11004004) //CLNT
 								CSR(timermatchh) = rs2;
 							else if (addy == 0x11004000) //CLNT
 								CSR(timermatchl) = rs2;
 							else if (addy == 0x11100000) //SYSCON (reboot, poweroff, etc.)
 							{
-								SETCSR(pc, pc + 4);
+								SETCSR(pc, pc + ilen);
 								return rs2; // NOTE: PC will be PC of Syscon.
 							}
 							else
 								MINIRV32_HANDLE_MEM_STORE_CONTROL(addy, rs2);
+#endif
 						}
 						else
 						{
@@ -289,6 +651,7 @@ MINIRV32_STEPPROTO
 					}
 					else
 					{
+						MINIRV32_CODE_STORE(addy);
 						switch ((ir >> 12) & 0x7)
 						{
 							//SB, SH, SW
@@ -300,14 +663,12 @@ MINIRV32_STEPPROTO
 					}
 					break;
 				}
-				case 0x13: // Op-immediate 0b0010011
-				case 0x33: // Op           0b0110011
+				MINIRV32_OP(opimm, 0x13) // Op-immediate 0b0010011
+				MINIRV32_OP(op, 0x33) // Op           0b0110011
 				{
-					uint32_t imm = ir >> 20;
-					imm = imm | ((imm & 0x800) ? 0xfffff000 : 0);
-					uint32_t rs1 = REG((ir >> 15) & 0x1f);
+					uint32_t rs1 = REG(d->rs1);
 					uint32_t is_reg = !!(ir & 0x20);
-					uint32_t rs2 = is_reg ? REG(imm & 0x1f) : imm;
+					uint32_t rs2 = is_reg ? REG(d->rs2) : (uint32_t)d->imm;
 
 					if (is_reg && (ir & 0x02000000))
 					{
@@ -321,7 +682,7 @@ MINIRV32_STEPPROTO
 #else
 							CUSTOM_MULH
 #endif
-						case 4: if (rs2 == 0) rval = -1; else rval = ((int32_t)rs1 == INT32_MIN && (int32_t)rs2 == -1) ? rs1 : ((int32_t)rs1 / (int32_t)rs2); break; // DIV
+						case 4: if (rs2 == 0) rval = -1; else rval = ((int32_t)rs1 == INT32_MIN && (int32_t)rs2 == -1) ? rs1 : (uint32_t)((int32_t)rs1 / (int32_t)rs2); break; // DIV
 						case 5: if (rs2 == 0) rval = 0xffffffff; else rval = rs1 / rs2; break; // DIVU
 						case 6: if (rs2 == 0) rval = rs1; else rval = ((int32_t)rs1 == INT32_MIN && (int32_t)rs2 == -1) ? 0 : ((uint32_t)((int32_t)rs1 % (int32_t)rs2)); break; // REM
 						case 7: if (rs2 == 0) rval = rs1; else rval = rs1 % rs2; break; // REMU
@@ -336,23 +697,27 @@ MINIRV32_STEPPROTO
 						case 2: rval = (int32_t)rs1 < (int32_t)rs2; break;
 						case 3: rval = rs1 < rs2; break;
 						case 4: rval = rs1 ^ rs2; break;
-						case 5: rval = (ir & 0x40000000) ? (((int32_t)rs1) >> (rs2 & 0x1F)) : (rs1 >> (rs2 & 0x1F)); break;
+						case 5: rval = (ir & 0x40000000) ? (uint32_t)(((int32_t)rs1) >> (rs2 & 0x1F)) : (rs1 >> (rs2 & 0x1F)); break;
 						case 6: rval = rs1 | rs2; break;
 						case 7: rval = rs1 & rs2; break;
 						}
 					}
 					break;
 				}
-				case 0x0f: // 0b0001111
-					rdid = 0;   // fencetype = (ir >> 12) & 0b111; We ignore fences in this impl.
+				MINIRV32_OP(fence, 0x0f) // 0b0001111
+					// fencetype = (ir >> 12) & 0b111; We ignore fences in this impl, except for fence.i.
+#ifdef MINIRV32_DECODE_CACHE
+					if (((ir >> 12) & 0x7) == 1)
+						MiniRV32IMAFlushDecodeCache();
+#endif
 					break;
-				case 0x73: // Zifencei+Zicsr  (0b1110011)
+				MINIRV32_OP(system, 0x73) // Zifencei+Zicsr  (0b1110011)
 				{
 					uint32_t csrno = ir >> 20;
 					uint32_t microop = (ir >> 12) & 0x7;
 					if ((microop & 3)) // It's a Zicsr function.
 					{
-						int rs1imm = (ir >> 15) & 0x1f;
+						int rs1imm = d->rs1;
 						uint32_t rs1 = REG(rs1imm);
 						uint32_t writeval = rs1;
 
@@ -370,7 +735,7 @@ MINIRV32_STEPPROTO
 						case 0x342: rval = CSR(mcause); break;
 						case 0x343: rval = CSR(mtval); break;
 						case 0xf11: rval = 0xff0ff0ff; break; //mvendorid
-						case 0x301: rval = 0x40401101; break; //misa (XLEN=32, IMA+X)
+						case 0x301: rval = MINIRV32_MISA; break; //misa
 							//case 0x3B0: rval = 0; break; //pmpaddr0
 							//case 0x3a0: rval = 0; break; //pmpcfg0
 							//case 0xf12: rval = 0x00000000; break; //marchid
@@ -448,10 +813,10 @@ MINIRV32_STEPPROTO
 						trap = (2 + 1); 				// Note micrrop 0b100 == undefined.
 					break;
 				}
-				case 0x2f: // RV32A (0b00101111)
+				MINIRV32_OP(amo, 0x2f) // RV32A (0b00101111)
 				{
-					uint32_t rs1 = REG((ir >> 15) & 0x1f);
-					uint32_t rs2 = REG((ir >> 20) & 0x1f);
+					uint32_t rs1 = REG(d->rs1);
+					uint32_t rs2 = REG(d->rs2);
 					uint32_t irmid = (ir >> 27) & 0x1f;
 
 					rs1 -= MINIRV32_RAM_IMAGE_OFFSET;
@@ -465,7 +830,13 @@ MINIRV32_STEPPROTO
 					}
 					else
 					{
+#ifdef MINIRV32_AMO_PTR
+						// LR/SC may not write, keep those on the plain path
+						uint32_t* amo = ((irmid & 0x1e) != 2 && !(rs1 & 3)) ? MINIRV32_AMO_PTR(rs1) : 0;
+						rval = amo ? *amo : MINIRV32_LOAD4(rs1);
+#else
 						rval = MINIRV32_LOAD4(rs1);
+#endif
 
 						// Referenced a little bit of https://github.com/franzflasch/riscv_em/blob/master/src/core/core.c
 						uint32_t dowrite = 1;
@@ -490,12 +861,21 @@ MINIRV32_STEPPROTO
 						case 28: rs2 = (rs2 > rval) ? rs2 : rval; break; //AMOMAXU.W (0b11100)
 						default: trap = (2 + 1); dowrite = 0; break; //Not supported.
 						}
-						if (dowrite) MINIRV32_STORE4(rs1, rs2);
+						if (dowrite)
+						{
+							MINIRV32_CODE_STORE(rs1);
+#ifdef MINIRV32_AMO_PTR
+							if (amo)
+								*amo = rs2;
+							else
+#endif
+							MINIRV32_STORE4(rs1, rs2);
+						}
 					}
 					break;
 				}
-				default: trap = (2 + 1); // Fault: Invalid opcode.
-				}
+				MINIRV32_OP_DEFAULT trap = (2 + 1); // Fault: Invalid opcode.
+				MINIRV32_DISPATCH_END
 
 				// If there was a trap, do NOT allow register writeback.
 				if (trap)
@@ -509,12 +889,13 @@ MINIRV32_STEPPROTO
 
 			MINIRV32_POSTEXEC(pc, ir, trap);
 
-			pc += 4;
+			pc += ilen;
 		}
 
 	// Handle traps and interrupts.
 	if (trap)
 	{
+		MINIRV32_TRAP(trap);
 		if (trap & 0x80000000) // If prefixed with 1 in MSB, it's an interrupt, not a trap.
 		{
 			SETCSR(mcause, trap);
@@ -0,0 +1,117 @@
+/*
+ * MMIO device registry and RAM word patches for mrv32, see mmio.h.
+ */
+
+#include "mmio.h"
+#include "vram.h"
+#include "perf.h"
+
+VMUINT32 mmio_patch_lo = 0;
+VMUINT32 mmio_patch_span = 0;
+
+static mmio_dev_t mmio_devs[MMIO_MAX_DEVICES];
+static int mmio_dev_count = 0;
+static mmio_dev_t *mmio_last = NULL;           // Device hit by the last access
+
+static mmio_patch_t mmio_patches[MMIO_MAX_PATCHES];
+static int mmio_patch_count = 0;
+
+// Add a device at [base, base + size). Returns 0 if the table is full or the range overlaps another device.
+int mmio_register(VMUINT32 base, VMUINT32 size, const char *name, mmio_load_t load, mmio_store_t store) {
+	int i, j;
+
+	if (mmio_dev_count == MMIO_MAX_DEVICES || size == 0)
+		return 0;
+	for (i = 0; i < mmio_dev_count && mmio_devs[i].base < base; i++)
+		;
+	if ((i > 0 && base - mmio_devs[i - 1].base < mmio_devs[i - 1].size) ||
+		(i < mmio_dev_count && mmio_devs[i].base - base < size))
+		return 0;
+
+	for (j = mmio_dev_count; j > i; j--)
+		mmio_devs[j] = mmio_devs[j - 1];
+	mmio_devs[i].base = base;
+	mmio_devs[i].size = size;
+	mmio_devs[i].name = name;
+	mmio_devs[i].load = load;
+	mmio_devs[i].store = store;
+	mmio_devs[i].exits = 0;
+	mmio_dev_count++;
+	mmio_last = NULL; // Entries moved
+	return 1;
+}
+
+static mmio_dev_t *mmio_find(VMUINT32 addr) {
+	int lo = 0, hi = mmio_dev_count - 1, mid;
+
+	if (mmio_last && addr - mmio_last->base < mmio_last->size)
+		return mmio_last;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (addr < mmio_devs[mid].base)
+			hi = mid - 1;
+		else if (addr - mmio_devs[mid].base >= mmio_devs[mid].size)
+			lo = mid + 1;
+		else
+			return mmio_last = &mmio_devs[mid];
+	}
+	return NULL;
+}
+
+// Registered devices in address order, NULL past the last one
+mmio_dev_t *mmio_device(int i) {
+	return i < mmio_dev_count ? &mmio_devs[i] : NULL;
+}
+
+// Unmapped addresses read as 0
+VMUINT32 mmio_load(VMUINT32 addr) {
+	mmio_dev_t *d = mmio_find(addr);
+	if (d == NULL)
+		return 0;
+	PERF_INC(d->exits);
+	return d->load ? d->load(addr - d->base) : 0;
+}
+
+// Unmapped addresses ignore writes
+int mmio_store(VMUINT32 addr, VMUINT32 val) {
+	mmio_dev_t *d = mmio_find(addr);
+	if (d == NULL)
+		return 0;
+	PERF_INC(d->exits);
+	return d->store ? d->store(addr - d->base, val) : 0;
+}
+
+// Make word loads from RAM offset ofs return val, whatever is stored there
+int mmio_patch_add(VMUINT32 ofs, VMUINT32 val) {
+	VMUINT32 lo, hi;
+
+	if (mmio_patch_count == MMIO_MAX_PATCHES || (ofs & 3))
+		return 0;
+	mmio_patches[mmio_patch_count].ofs = ofs;
+	mmio_patches[mmio_patch_count].val = val;
+	mmio_patch_count++;
+
+	// Keep the pages of all patches in one range, so other loads only cost a compare
+	lo = ofs & ~VRAM_PAGE_MASK;
+	hi = lo + VRAM_PAGE_SIZE;
+	if (mmio_patch_span) {
+		if (mmio_patch_lo < lo)
+			lo = mmio_patch_lo;
+		if (mmio_patch_lo + mmio_patch_span > hi)
+			hi = mmio_patch_lo + mmio_patch_span;
+	}
+	mmio_patch_lo = lo;
+	mmio_patch_span = hi - lo;
+	return 1;
+}
+
+int mmio_patch_find(VMUINT32 ofs, VMUINT32 *val) {
+	int i;
+	for (i = 0; i < mmio_patch_count; i++) {
+		if (mmio_patches[i].ofs == ofs) {
+			*val = mmio_patches[i].val;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "vmsys.h"
+
+/*
+ * MMIO device registry for the core's 0x10000000 - 0x12000000 window.
+ *
+ * Devices register a range and a pair of callbacks, see mmio_register().
+ * The table is kept sorted by base; a lookup checks the device that was
+ * hit last, then does a binary search, so devices can be added without
+ * slowing down the others.
+ *
+ * Word patches are separate: a guest RAM word that always reads back as
+ * a fixed value, see mmio_patch_add(). Word loads only look at the patch
+ * table when they fall inside the pages the patches live in.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MMIO_MAX_DEVICES 16
+#define MMIO_MAX_PATCHES 8
+
+typedef VMUINT32 (*mmio_load_t)(VMUINT32 ofs);
+typedef int (*mmio_store_t)(VMUINT32 ofs, VMUINT32 val); // Nonzero leaves the core's step, see MINIRV32_HANDLE_MEM_STORE_CONTROL in main.c
+
+typedef struct {
+	VMUINT32 base;
+	VMUINT32 size;
+	const char *name;                         // For the profiler, see perf.h
+	mmio_load_t load;                         // NULL reads as 0
+	mmio_store_t store;                       // NULL ignores writes
+	VMUINT32 exits;                           // Accesses, counted with PERF_ENABLE
+} mmio_dev_t;
+
+typedef struct {
+	VMUINT32 ofs;                             // Guest RAM offset, word aligned
+	VMUINT32 val;
+} mmio_patch_t;
+
+extern VMUINT32 mmio_patch_lo;                // Pages holding patches start here...
+extern VMUINT32 mmio_patch_span;              // ...and span this many bytes, 0 if there are none
+
+int mmio_register(VMUINT32 base, VMUINT32 size, const char *name, mmio_load_t load, mmio_store_t store);
+mmio_dev_t *mmio_device(int i);
+VMUINT32 mmio_load(VMUINT32 addr);
+int mmio_store(VMUINT32 addr, VMUINT32 val);
+
+int mmio_patch_add(VMUINT32 ofs, VMUINT32 val);
+int mmio_patch_find(VMUINT32 ofs, VMUINT32 *val);
+
+// Patched value of the word load at RAM offset ofs, if any
+static inline int mmio_patched(VMUINT32 ofs, VMUINT32 *val) {
+	return ofs - mmio_patch_lo < mmio_patch_span && mmio_patch_find(ofs, val);
+}
+
+#ifdef __cplusplus
+}
+#endif
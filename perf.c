@@ -0,0 +1,217 @@
+/*
+ * Performance counters for mrv32, see perf.h.
+ * Formatted one line at a time, for the SET menu page and for PERF_FILE.
+ */
+
+#include "perf.h"
+#include "mmio.h"
+#include "vram.h"
+#include "vmchset.h"
+#include "stdio.h"
+#include "string.h"
+
+#ifdef PERF_ENABLE
+perf_t perf;
+#endif
+
+// Lines before the MMIO devices, which take two per line after them
+#define PERF_FIXED (8 + PERF_LAT_STAGES)
+
+#ifdef PERF_ENABLE
+// Upper bounds (ms) of the latency buckets, the last one also takes anything longer
+static const VMUINT16 perf_lat_edges[PERF_LAT_BUCKETS] = {
+	1, 2, 3, 5, 7, 10, 15, 20, 30, 40, 50, 70,
+	100, 150, 200, 300, 400, 500, 700, 1000, 1500, 2000, 3000, 5000
+};
+
+static const char *perf_lat_names[PERF_LAT_STAGES] = {
+	"wait ",                                  // Key to guest read: scheduler and UART polling
+	"guest",                                  // Read to echo
+	"draw ",                                  // Echo to layer flush
+	"total"                                   // Key to layer flush
+};
+#endif
+
+void perf_reset(void) {
+#ifdef PERF_ENABLE
+	mmio_dev_t *d;
+	int i;
+
+	memset(&perf, 0, sizeof(perf));
+	perf.since = vm_get_tick_count();
+	for (i = 0; (d = mmio_device(i)) != NULL; i++)
+		d->exits = 0;
+#endif
+}
+
+#ifdef PERF_ENABLE
+static void perf_hist_add(perf_hist_t *h, VMUINT32 ms) {
+	int i;
+	for (i = 0; i < PERF_LAT_BUCKETS - 1 && ms > perf_lat_edges[i]; i++)
+		;
+	h->bucket[i]++;
+	h->count++;
+}
+
+// Upper bound of the bucket holding the pct'th percentile, 0 without samples
+static VMUINT32 perf_hist_pct(const perf_hist_t *h, VMUINT32 pct) {
+	VMUINT32 need = (h->count * pct + 99) / 100, sum = 0;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+	for (i = 0; i < PERF_LAT_BUCKETS - 1; i++) {
+		sum += h->bucket[i];
+		if (sum >= need)
+			break;
+	}
+	return perf_lat_edges[i];
+}
+#endif
+
+// A keystroke passed stage. Times each stage from the one before, and the whole way once it is on screen.
+void perf_lat(int stage) {
+#ifdef PERF_ENABLE
+	VMUINT32 now = vm_get_tick_count();
+
+	if (stage == PERF_LAT_KEY) {
+		if (perf.lat_stage != PERF_LAT_KEY && now - perf.lat_tick[PERF_LAT_KEY] < PERF_LAT_TIMEOUT)
+			return; // One in flight already
+		perf.lat_tick[PERF_LAT_KEY] = now;
+		perf.lat_stage = PERF_LAT_READ;
+		return;
+	}
+	if (stage != (int)perf.lat_stage)
+		return;
+	perf.lat_tick[stage] = now;
+	perf_hist_add(&perf.lat[stage - 1], now - perf.lat_tick[stage - 1]);
+	if (stage == PERF_LAT_SHOWN) {
+		perf_hist_add(&perf.lat[PERF_LAT_STAGES - 1], now - perf.lat_tick[PERF_LAT_KEY]);
+		perf.lat_stage = PERF_LAT_KEY;
+	} else {
+		perf.lat_stage++;
+	}
+#else
+	(void)stage;
+#endif
+}
+
+#ifdef PERF_ENABLE
+// Counter as text, shortened to k or M on screen so a line fits
+static char *perf_num(char *buf, VMUINT32 n, int full) {
+	if (full || n < 10000)
+		sprintf(buf, "%u", n);
+	else if (n < 10000000)
+		sprintf(buf, "%uk", n / 1000);
+	else
+		sprintf(buf, "%uM", n / 1000000);
+	return buf;
+}
+#endif
+
+// Line i of the counters, returns 0 past the last one
+int perf_line(int i, char *buf, int full) {
+#ifdef PERF_ENABLE
+	char a[12], b[12], c[12], e[12];
+	VMUINT32 *op = perf.insn, busy = perf.ms_run + perf.ms_draw, up = vm_get_tick_count() - perf.since;
+	mmio_dev_t *d;
+	perf_hist_t *h;
+
+	switch (i) {
+	case 0: // The terminal is fed from socRun(), so con is part of run. Idle is mostly WFI.
+		sprintf(buf, "ms run %s draw %s con %s idle %s", perf_num(a, perf.ms_run, full), perf_num(b, perf.ms_draw, full),
+			perf_num(c, perf.ms_console, full), perf_num(e, up > busy ? up - busy : 0, full));
+		return 1;
+	case 1: // OP-IMM, OP, LUI, AUIPC; LOAD; STORE
+		sprintf(buf, "alu %s ld %s st %s", perf_num(a, op[4] + op[12] + op[13] + op[5], full),
+			perf_num(b, op[0], full), perf_num(c, op[8], full));
+		return 1;
+	case 2: // BRANCH; JAL, JALR; SYSTEM
+		sprintf(buf, "br %s jmp %s sys %s", perf_num(a, op[24], full),
+			perf_num(b, op[27] + op[25], full), perf_num(c, op[28], full));
+		return 1;
+	case 3: // AMO; MISC-MEM
+		sprintf(buf, "amo %s fence %s jit %s", perf_num(a, op[11], full),
+			perf_num(b, op[3], full), perf_num(c, perf.jit_insns, full));
+		return 1;
+	case 4:
+		sprintf(buf, "mem ld %s st %s", perf_num(a, perf.loads, full), perf_num(b, perf.stores, full));
+		return 1;
+	case 5: // Every bus access looks up one page
+		sprintf(buf, "cache hit %s miss %s", perf_num(a, perf.loads + perf.stores - perf.faults, full),
+			perf_num(b, perf.faults, full));
+		return 1;
+	case 6:
+		sprintf(buf, "file rd %s wr %s KB %s/%s", perf_num(a, perf.file_reads, full), perf_num(b, perf.file_writes, full),
+			perf_num(c, perf.bytes_read >> 10, full), perf_num(e, perf.bytes_written >> 10, full));
+		return 1;
+	case 7:
+		sprintf(buf, "trap %s irq %s", perf_num(a, perf.traps, full), perf_num(b, perf.interrupts, full));
+		return 1;
+	case 8: case 9: case 10: case 11: // Keystroke latency
+		h = &perf.lat[i - 8];
+		sprintf(buf, "%s ms p50 %u p95 %u p99 %u n %s", perf_lat_names[i - 8], perf_hist_pct(h, 50),
+			perf_hist_pct(h, 95), perf_hist_pct(h, 99), perf_num(a, h->count, full));
+		return 1;
+	}
+
+	d = mmio_device((i - PERF_FIXED) * 2);
+	if (i < PERF_FIXED || d == NULL)
+		return 0;
+	if (mmio_device((i - PERF_FIXED) * 2 + 1) == NULL) {
+		sprintf(buf, "%s %s", d->name, perf_num(a, d->exits, full));
+	} else {
+		sprintf(buf, "%s %s %s %s", d->name, perf_num(a, d->exits, full),
+			d[1].name, perf_num(e, d[1].exits, full));
+	}
+	return 1;
+#else
+	(void)i;
+	(void)buf;
+	(void)full;
+	return 0;
+#endif
+}
+
+#ifdef PERF_ENABLE
+static int perf_write(VMFILE f, const char *text) {
+	VMUINT n = 0;
+	vm_file_write_opt(f, (void*)text, strlen(text), &n);
+	return n == strlen(text);
+}
+#endif
+
+// Write every counter in full to PERF_FILE, then the latency histograms as
+// "upper bound (ms):count" for each bucket that has samples
+int perf_dump(void) {
+#ifdef PERF_ENABLE
+	VMWCHAR path[100];
+	char line[PERF_LINE + 2];
+	VMFILE f;
+	int i, j, ok = 1;
+
+	vm_gb2312_to_ucs2(path, sizeof(path), PERF_FILE);
+	f = vm_file_open(path, MODE_CREATE_ALWAYS_WRITE, VM_TRUE);
+	if (f < 0)
+		return 0;
+	for (i = 0; ok && perf_line(i, line, 1); i++) {
+		strcat(line, "\r\n");
+		ok = perf_write(f, line);
+	}
+	for (i = 0; ok && i < PERF_LAT_STAGES; i++) {
+		sprintf(line, "%s hist", perf_lat_names[i]);
+		ok = perf_write(f, line);
+		for (j = 0; ok && j < PERF_LAT_BUCKETS; j++) {
+			if (perf.lat[i].bucket[j] == 0)
+				continue;
+			sprintf(line, " %u:%u", perf_lat_edges[j], perf.lat[i].bucket[j]);
+			ok = perf_write(f, line);
+		}
+		ok = ok && perf_write(f, "\r\n");
+	}
+	vm_file_close(f);
+	return ok;
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "vmsys.h"
+
+/*
+ * Performance counters for the hot paths: instructions by opcode class,
+ * guest RAM accesses, the page cache and its file I/O, MMIO exits per
+ * device, traps and interrupts, where the host time goes, and how long a
+ * keystroke takes to come back on screen. They are
+ * plain 32-bit counters bumped in place, so they wrap after a long
+ * enough run; reset them from the PERF menu page.
+ *
+ * Shown live on the PERF page of the SET menu, which can also write them
+ * to PERF_FILE. Build with PERF_DISABLE to compile every counter out.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef PERF_DISABLE
+#define PERF_ENABLE
+#endif
+
+#define PERF_FILE "e:\\rv32ima\\perf.txt"
+#define PERF_LINE 80                          // Longest formatted line, with the terminator
+
+// Stages of a keystroke, timed from one to the next. One key is followed at a
+// time, keys typed while it is in flight aren't sampled.
+#define PERF_LAT_KEY 0                        // Into serial_in from the keypad
+#define PERF_LAT_READ 1                       // Read by the guest (UART RBR), or copied into a pvcon buffer
+#define PERF_LAT_ECHO 2                       // First guest output after that
+#define PERF_LAT_SHOWN 3                      // First layer flush after that, and back to PERF_LAT_KEY
+#define PERF_LAT_STAGES 4
+#define PERF_LAT_TIMEOUT 5000                 // A key without echo for this long (ms) is dropped
+#define PERF_LAT_BUCKETS 24                   // Histogram buckets, see perf_lat_edges in perf.c
+
+typedef struct {
+	VMUINT32 count;
+	VMUINT32 bucket[PERF_LAT_BUCKETS];
+} perf_hist_t;
+
+typedef struct {
+	VMUINT32 insn[32];                        // Interpreted instructions by major opcode, (ir >> 2) & 31
+	VMUINT32 jit_insns;                       // Instructions run as translated code
+	VMUINT32 loads, stores;                   // Guest RAM accesses through the bus, decode cache fills included, AMOs count as both
+	VMUINT32 faults;                          // Page cache misses, the rest of the accesses hit
+	VMUINT32 file_reads, file_writes;         // Calls into the RAM file or base image
+	VMUINT32 bytes_read, bytes_written;
+	VMUINT32 traps, interrupts;
+	VMUINT32 ms_run, ms_draw, ms_console;     // Host time in socRun(), draw() and the terminal parser
+	VMUINT32 since;                           // Tick count at the last reset
+	perf_hist_t lat[PERF_LAT_STAGES];         // Stage to stage (ms), the last one key to screen
+	VMUINT32 lat_stage;                       // Next stage of the key in flight, PERF_LAT_KEY if none
+	VMUINT32 lat_tick[PERF_LAT_STAGES];       // When it passed each stage
+} perf_t;
+
+#ifdef PERF_ENABLE
+extern perf_t perf;
+
+#define PERF_INC( x ) ((x)++)
+#define PERF_ADD( x, n ) ((x) += (n))
+#define PERF_TIME_BEGIN( t ) VMUINT32 t = vm_get_tick_count()
+#define PERF_TIME_END( t, x ) ((x) += vm_get_tick_count() - (t))
+#define PERF_LAT_BEGIN() perf_lat(PERF_LAT_KEY)
+#define PERF_LAT( stage ) (perf.lat_stage == (stage) ? perf_lat(stage) : (void)0)
+#else // Statements still, so an if / else around them keeps its body
+#define PERF_INC( x ) ((void)0)
+#define PERF_ADD( x, n ) ((void)0)
+#define PERF_TIME_BEGIN( t ) ((void)0)
+#define PERF_TIME_END( t, x ) ((void)0)
+#define PERF_LAT_BEGIN() ((void)0)
+#define PERF_LAT( stage ) ((void)0)
+#endif
+
+void perf_reset(void);
+void perf_lat(int stage);
+int perf_line(int i, char *buf, int full);
+int perf_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Platform-level interrupt controller for mrv32, see plic.h.
+ */
+
+#include "plic.h"
+#include "string.h"
+
+plic_t plic;
+
+void plic_reset(void) {
+	memset(&plic, 0, sizeof(plic));
+}
+
+// Level-triggered gateway: a request is pending while the line is high,
+// but not again until the previous one is completed
+void plic_set_irq(int src, int level) {
+	VMUINT32 bit = 1u << src;
+
+	if (level) {
+		plic.level |= bit;
+		if (!(plic.claimed & bit))
+			plic.pending |= bit;
+	} else {
+		plic.level &= ~bit;
+		plic.pending &= ~bit;
+	}
+}
+
+// Highest priority pending and enabled source above the threshold, 0 if none
+static int plic_best(void) {
+	VMUINT32 cand = plic.pending & plic.enable;
+	VMUINT32 best_prio = plic.threshold;
+	int src, best = 0;
+
+	if (cand == 0)
+		return 0;
+	for (src = 1; src < PLIC_SOURCES; src++)
+		if ((cand & (1u << src)) && plic.priority[src] > best_prio) {
+			best_prio = plic.priority[src];
+			best = src;
+		}
+	return best;
+}
+
+int plic_meip(void) {
+	return plic_best() != 0;
+}
+
+VMUINT32 plic_load(VMUINT32 ofs) {
+	if (ofs < PLIC_SOURCES * 4)
+		return plic.priority[ofs >> 2];
+	if (ofs == 0x1000)
+		return plic.pending;
+	if (ofs == 0x2000)
+		return plic.enable;
+	if (ofs == 0x200000)
+		return plic.threshold;
+	if (ofs == 0x200004) { // Claim
+		int src = plic_best();
+		if (src) {
+			plic.pending &= ~(1u << src);
+			plic.claimed |= 1u << src;
+		}
+		return src;
+	}
+	return 0;
+}
+
+void plic_store(VMUINT32 ofs, VMUINT32 val) {
+	if (ofs < PLIC_SOURCES * 4) {
+		if (ofs)
+			plic.priority[ofs >> 2] = val & 7;
+	} else if (ofs == 0x2000) {
+		plic.enable = val & ~1u;
+	} else if (ofs == 0x200000) {
+		plic.threshold = val & 7;
+	} else if (ofs == 0x200004 && val && val < PLIC_SOURCES) { // Complete
+		plic.claimed &= ~(1u << val);
+		if (plic.level & (1u << val))
+			plic.pending |= 1u << val; // Still asserted
+	}
+}
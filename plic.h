@@ -0,0 +1,45 @@
+#pragma once
+#include "vmsys.h"
+
+/*
+ * Minimal RISC-V PLIC: one hart, one context (M-mode), up to 31
+ * level-triggered sources. MEIP in mip follows plic_meip(), see
+ * soc_irq_update() in main.c.
+ *
+ * Register layout is the usual SiFive one, relative to PLIC_BASE:
+ *   0x000000 + 4 * n   source n priority (0: never interrupts)
+ *   0x001000           pending bits
+ *   0x002000           context 0 enable bits
+ *   0x200000           context 0 priority threshold
+ *   0x200004           context 0 claim / complete
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Inside the core's 0x10000000 - 0x12000000 MMIO window, see mrv32.dts
+#define PLIC_BASE 0x10400000
+#define PLIC_SIZE 0x400000
+#define PLIC_SOURCES 32                       // Source 0 is reserved
+
+typedef struct {
+	VMUINT32 priority[PLIC_SOURCES];
+	VMUINT32 level;                           // Interrupt lines as driven by the devices
+	VMUINT32 pending;
+	VMUINT32 claimed;                         // Claimed and not completed yet
+	VMUINT32 enable;
+	VMUINT32 threshold;
+} plic_t;
+
+extern plic_t plic;
+
+void plic_reset(void);
+void plic_set_irq(int src, int level);
+int plic_meip(void);
+VMUINT32 plic_load(VMUINT32 ofs);
+void plic_store(VMUINT32 ofs, VMUINT32 val);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,201 @@
+/*
+ * virtio-mmio console for mrv32, see pvcon.h.
+ */
+
+#include "pvcon.h"
+#include "virtio.h"
+#include "vram.h"
+#include "ring.h"
+#include "uart.h"
+#include "perf.h"
+
+// Console_io.h pulls in main.h, which can only be included once per program
+extern ring_t serial_in;
+void console_str_with_length_in(const char* str, int length);
+
+#define PVCON_DEVICE_ID 3                     // Console
+
+pvcon_t pvcon;
+
+static VMUINT32 pvcon_ram_size;
+static pvcon_dma_t pvcon_written;
+
+void pvcon_init(VMUINT32 ram_size, pvcon_dma_t written) {
+	pvcon_ram_size = ram_size;
+	pvcon_written = written;
+	pvcon_reset();
+}
+
+void pvcon_reset(void) {
+	memset(&pvcon, 0, sizeof(pvcon));
+}
+
+// Guest RAM offset of a guest physical range, 0xFFFFFFFF if it isn't all in RAM
+static VMUINT32 pvcon_ram(VMUINT32 addr, VMUINT32 len) {
+	VMUINT32 ofs = addr - VIRTIO_RAM_OFFSET;
+
+	if (ofs >= pvcon_ram_size || pvcon_ram_size - ofs < len)
+		return 0xFFFFFFFF;
+	return ofs;
+}
+
+// Guest RAM offsets of the rings of a queue the device may use now. Returns 0 if it can't.
+static int pvcon_rings(const pvcon_queue_t *q, VMUINT32 *avail, VMUINT32 *used) {
+	if (!q->ready || !(pvcon.status & VIRTIO_S_DRIVER_OK) || q->num == 0)
+		return 0;
+	*avail = pvcon_ram(q->avail, 4 + 2 * q->num);
+	*used = pvcon_ram(q->used, 4 + 8 * q->num);
+	return *avail != 0xFFFFFFFF && *used != 0xFFFFFFFF;
+}
+
+// Move the bytes of the chain at head: the device readable buffers to the terminal,
+// or serial_in into the writable ones (rx). Returns the number of bytes written into them.
+static VMUINT32 pvcon_chain(const pvcon_queue_t *q, VMUINT32 head, int rx) {
+	VMUINT32 d = head, da, ofs, len, flags, n, written = 0;
+	int i;
+
+	for (i = 0; i < (int)q->num && d < q->num; i++) {
+		da = pvcon_ram(q->desc + 16 * d, 16);
+		if (da == 0xFFFFFFFF)
+			break;
+		len = vram_load4(da + 8);
+		flags = vram_load2(da + 12);
+		ofs = pvcon_ram(vram_load4(da), len);
+		if (ofs == 0xFFFFFFFF || vram_load4(da + 4))
+			break; // Off the end of RAM, return what's done
+		if (!(flags & VIRTIO_D_WRITE) == !rx) {
+			while (len) {
+				n = VRAM_PAGE_SIZE - (ofs & VRAM_PAGE_MASK); // vram_ptr is valid up to the end of the page
+				if (n > len)
+					n = len;
+				if (rx) {
+					n = ring_pop(&serial_in, (char*)vram_ptr_w(ofs), n);
+					if (n == 0)
+						return written;
+					if (pvcon_written)
+						pvcon_written(ofs, n);
+					written += n;
+				} else {
+					console_str_with_length_in((const char*)vram_ptr(ofs), n);
+				}
+				ofs += n;
+				len -= n;
+			}
+		}
+		if (!(flags & VIRTIO_D_NEXT))
+			break;
+		d = vram_load2(da + 14);
+	}
+	return written;
+}
+
+// Hand the chain at head back on the used ring with len bytes written
+static void pvcon_used(pvcon_queue_t *q, VMUINT32 avail, VMUINT32 used, VMUINT32 head, VMUINT32 len) {
+	VMUINT32 slot = used + 4 + 8 * (q->last_avail % q->num);
+
+	vram_store4(slot, head);
+	vram_store4(slot + 4, len);
+	q->last_avail++;
+	vram_store2(used + 2, (VMUINT16)q->last_avail);
+	if (!(vram_load2(avail) & VIRTIO_AVAIL_F_NO_INTERRUPT))
+		pvcon.isr |= 1;
+}
+
+// transmitq notified: pass every buffer the driver made available to the terminal
+static void pvcon_tx(void) {
+	pvcon_queue_t *q = &pvcon.queue[PVCON_TX];
+	VMUINT32 avail, used, head;
+
+	if (!pvcon_rings(q, &avail, &used))
+		return;
+
+	uart_tx_flush(); // Keep the order with what went out through the UART
+
+	while ((VMUINT16)q->last_avail != vram_load2(avail + 2)) {
+		head = vram_load2(avail + 4 + 2 * (q->last_avail % q->num));
+		pvcon_chain(q, head, 0);
+		pvcon_used(q, avail, used, head, 0);
+		pvcon.active = 1;
+	}
+}
+
+// Move waiting keyboard input into receiveq. Returns 0 if the guest doesn't use it and the UART should get it.
+int pvcon_poll(void) {
+	pvcon_queue_t *q = &pvcon.queue[PVCON_RX];
+	VMUINT32 avail, used, head, len;
+
+	if (!pvcon.active || !pvcon_rings(q, &avail, &used))
+		return 0;
+
+	// Input the guest has no buffers for waits in serial_in
+	while (ring_avail(&serial_in) && (VMUINT16)q->last_avail != vram_load2(avail + 2)) {
+		head = vram_load2(avail + 4 + 2 * (q->last_avail % q->num));
+		len = pvcon_chain(q, head, 1);
+		pvcon_used(q, avail, used, head, len);
+		PERF_LAT(PERF_LAT_READ);
+	}
+	return 1;
+}
+
+int pvcon_irq(void) {
+	return pvcon.isr != 0;
+}
+
+VMUINT32 pvcon_load(VMUINT32 reg) {
+	pvcon_queue_t *q = pvcon.queue_sel < 2 ? &pvcon.queue[pvcon.queue_sel] : NULL;
+
+	switch (reg) {
+	case 0x000: return VIRTIO_MAGIC;
+	case 0x004: return 2;
+	case 0x008: return PVCON_DEVICE_ID;
+	case 0x00c: return VIRTIO_VENDOR;
+	case 0x010: return pvcon.dev_features_sel == 1 ? VIRTIO_F_VERSION_1 : 0;
+	case 0x034: return q ? PVCON_QUEUE_MAX : 0;
+	case 0x044: return q ? q->ready : 0;
+	case 0x060: return pvcon.isr;
+	case 0x070: return pvcon.status;
+	case 0x0fc: return 0;
+	}
+	return 0; // No config space without VIRTIO_CONSOLE_F_SIZE and friends
+}
+
+void pvcon_store(VMUINT32 reg, VMUINT32 val) {
+	pvcon_queue_t *q = pvcon.queue_sel < 2 ? &pvcon.queue[pvcon.queue_sel] : NULL;
+
+	switch (reg) {
+	case 0x014: pvcon.dev_features_sel = val; break;
+	case 0x020:
+		if (pvcon.drv_features_sel < 2)
+			pvcon.drv_features[pvcon.drv_features_sel] = val;
+		break;
+	case 0x024: pvcon.drv_features_sel = val; break;
+	case 0x030: pvcon.queue_sel = val; break;
+	case 0x038:
+		if (q && val <= PVCON_QUEUE_MAX)
+			q->num = val;
+		break;
+	case 0x044:
+		if (q)
+			q->ready = val & 1;
+		break;
+	case 0x050:
+		if (val == PVCON_TX)
+			pvcon_tx();
+		else if (val == PVCON_RX)
+			pvcon_poll(); // New buffers, there may be input waiting for them
+		break;
+	case 0x064: pvcon.isr &= ~val; break;
+	case 0x070:
+		if (val == 0) {
+			pvcon_reset();
+			break;
+		}
+		pvcon.status = val;
+		if ((val & VIRTIO_S_FEATURES_OK) && !(pvcon.drv_features[1] & VIRTIO_F_VERSION_1))
+			pvcon.status &= ~VIRTIO_S_FEATURES_OK; // Legacy drivers aren't supported
+		break;
+	case 0x080: if (q) q->desc = val; break;
+	case 0x090: if (q) q->avail = val; break;
+	case 0x0a0: if (q) q->used = val; break;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "vmsys.h"
+
+/*
+ * Console, virtio-mmio version 2 with the two queues of port 0 and no
+ * features: the stock virtio_console driver binds to it given "virtio,mmio"
+ * in the device tree, and the guest gets hvc0 (console=hvc0, or a getty on it).
+ * Same registers as vblk.h, QueueNotify takes the queue index.
+ *
+ * Queue 0 is receiveq: the host fills the driver's buffers from serial_in and
+ * raises PVCON_IRQ. Queue 1 is transmitq: on QueueNotify every buffer goes to
+ * the terminal in whole runs, one call per page. Input moves to receiveq once
+ * the guest has written to transmitq, before that the UART gets it, so kernels
+ * that have the driver but keep ttyS0 lose no keys.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PVCON_BASE 0x10001000
+#define PVCON_SIZE 0x200
+#define PVCON_IRQ 2                           // PLIC source
+#define PVCON_QUEUE_MAX 16                    // Descriptors in each queue, also the longest chain
+#define PVCON_RX 0                            // Queue indexes
+#define PVCON_TX 1
+
+typedef struct {
+	VMUINT32 num;
+	VMUINT32 ready;
+	VMUINT32 desc, avail, used;               // Guest physical addresses of the queue parts
+	VMUINT32 last_avail;                      // Avail ring index serviced up to, free running
+} pvcon_queue_t;
+
+typedef struct {
+	VMUINT32 status;                          // Device status, written by the driver
+	VMUINT32 dev_features_sel;
+	VMUINT32 drv_features_sel;
+	VMUINT32 drv_features[2];
+	VMUINT32 queue_sel;
+	pvcon_queue_t queue[2];
+	VMUINT32 isr;                             // InterruptStatus
+	VMUINT32 active;                          // The guest wrote to transmitq, input goes to receiveq
+} pvcon_t;                                    // Saved as is in state.bin
+
+typedef void (*pvcon_dma_t)(VMUINT32 ofs, VMUINT32 len); // Guest RAM written behind the core's back
+
+extern pvcon_t pvcon;
+
+void pvcon_init(VMUINT32 ram_size, pvcon_dma_t written);
+void pvcon_reset(void);
+int pvcon_poll(void);
+int pvcon_irq(void);
+VMUINT32 pvcon_load(VMUINT32 reg);
+void pvcon_store(VMUINT32 reg, VMUINT32 val);
+
+#ifdef __cplusplus
+}
+#endif
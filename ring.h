@@ -0,0 +1,90 @@
+#pragma once
+#include "vmsys.h"
+#include "string.h"
+
+/*
+ * Single producer / single consumer byte ring.
+ * The size is a power of two and head / tail run freely, so fill level and
+ * indexes are a subtraction and a mask. Only the producer writes head and
+ * only the consumer writes tail, so one side may run from an interrupt or
+ * another thread without a lock.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	char *buf;
+	VMUINT32 mask;                            // Size - 1
+	volatile VMUINT32 head;                   // Next byte written, producer only
+	volatile VMUINT32 tail;                   // Next byte read, consumer only
+} ring_t;
+
+// size must be a power of two
+static inline void ring_init(ring_t *r, char *buf, VMUINT32 size) {
+	r->buf = buf;
+	r->mask = size - 1;
+	r->head = r->tail = 0;
+}
+
+// Bytes waiting to be read
+static inline VMUINT32 ring_avail(const ring_t *r) {
+	return r->head - r->tail;
+}
+
+static inline VMUINT32 ring_space(const ring_t *r) {
+	return r->mask + 1 - (r->head - r->tail);
+}
+
+// Append up to len bytes, returns how many fit
+static inline VMUINT32 ring_push(ring_t *r, const char *data, VMUINT32 len) {
+	VMUINT32 head = r->head, ofs = head & r->mask, first;
+
+	if (len > ring_space(r))
+		len = ring_space(r);
+	first = r->mask + 1 - ofs;
+	if (first > len)
+		first = len;
+	memcpy(r->buf + ofs, data, first);
+	memcpy(r->buf, data + first, len - first);
+	r->head = head + len; // Publish after the data is in place
+	return len;
+}
+
+static inline int ring_push1(ring_t *r, char c) {
+	if (ring_space(r) == 0)
+		return 0;
+	r->buf[r->head & r->mask] = c;
+	r->head++;
+	return 1;
+}
+
+// Take up to len bytes, returns how many were read
+static inline VMUINT32 ring_pop(ring_t *r, char *data, VMUINT32 len) {
+	VMUINT32 tail = r->tail, ofs = tail & r->mask, first;
+
+	if (len > ring_avail(r))
+		len = ring_avail(r);
+	first = r->mask + 1 - ofs;
+	if (first > len)
+		first = len;
+	memcpy(data, r->buf + ofs, first);
+	memcpy(data + first, r->buf, len - first);
+	r->tail = tail + len;
+	return len;
+}
+
+// Next byte, -1 if the ring is empty
+static inline int ring_pop1(ring_t *r) {
+	int c;
+	if (r->head == r->tail)
+		return -1;
+	c = (VMUINT8)r->buf[r->tail & r->mask];
+	r->tail++;
+	return c;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,283 @@
+/*
+ * Whole machine snapshots for mrv32, see snap.h.
+ * A full base image once, then deltas of the pages dirtied in between.
+ */
+
+#include "snap.h"
+#include "vram.h"
+#include "vmchset.h"
+#include "vmstdlib.h"
+#include "string.h"
+
+int snap_valid = 0;
+
+static VMUINT8 *snap_buf = NULL;
+static VMUINT32 snap_buf_len;
+
+// Copy buffer, at least one page record (page number + page)
+static int snap_buf_get(void) {
+	snap_buf_len = SNAP_CHUNK;
+	while (snap_buf_len >= VRAM_PAGE_SIZE + 4) {
+		snap_buf = (VMUINT8*)vm_malloc(snap_buf_len);
+		if (snap_buf != NULL)
+			return 1;
+		snap_buf_len /= 2;
+	}
+	snap_buf_len = VRAM_PAGE_SIZE + 4;
+	snap_buf = (VMUINT8*)vm_malloc(snap_buf_len);
+	return snap_buf != NULL;
+}
+
+static void snap_buf_put(void) {
+	vm_free(snap_buf);
+	snap_buf = NULL;
+}
+
+static VMFILE snap_open(const char *name, VMUINT mode) {
+	VMWCHAR path[100];
+	vm_gb2312_to_ucs2(path, sizeof(path), (char*)name);
+	return vm_file_open(path, mode, VM_TRUE);
+}
+
+static void snap_delete(const char *name) {
+	VMWCHAR path[100];
+	vm_gb2312_to_ucs2(path, sizeof(path), (char*)name);
+	vm_file_delete(path);
+}
+
+static int snap_read(VMFILE f, VMUINT32 ofs, void *data, VMUINT32 len) {
+	VMUINT n = 0;
+	vm_file_seek_opt(f, ofs, BASE_BEGIN);
+	vm_file_read_opt(f, data, len, &n);
+	return n == len;
+}
+
+static int snap_write(VMFILE f, VMUINT32 ofs, const void *data, VMUINT32 len) {
+	VMUINT n = 0;
+	vm_file_seek_opt(f, ofs, BASE_BEGIN);
+	vm_file_write_opt(f, (void*)data, len, &n);
+	return n == len;
+}
+
+// Copy all of guest RAM between the backing store and f at ofs, through snap_buf
+static int snap_copy(VMFILE f, VMUINT32 ofs, int to_ram) {
+	VMUINT32 p, n, chunk = snap_buf_len & ~VRAM_PAGE_MASK, len = vram_pages << VRAM_PAGE_SHIFT;
+
+	for (p = 0; p < len; p += n) {
+		n = len - p < chunk ? len - p : chunk;
+		if (to_ram) {
+			if (!snap_read(f, ofs + p, snap_buf, n) || !vram_store_write(p, snap_buf, n))
+				return 0;
+		} else {
+			vram_store_read(p, snap_buf, n);
+			if (!snap_write(f, ofs + p, snap_buf, n))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+// New base from the backing store, drops the deltas
+static int snap_write_base(const void *state, VMUINT32 state_len) {
+	snap_header_t h;
+	VMFILE f;
+	int ok;
+
+	vram_lazy_fill(vram_pages); // The old base may still be backing guest RAM
+
+	f = snap_open(SNAP_FILE, MODE_CREATE_ALWAYS_WRITE);
+	if (f < 0)
+		return 0;
+
+	h.magic = SNAP_MAGIC;
+	h.version = SNAP_VERSION;
+	h.page_shift = VRAM_PAGE_SHIFT;
+	h.pages = vram_pages;
+	h.state_len = state_len;
+	ok = snap_write(f, 0, &h, sizeof(h)) && snap_write(f, sizeof(h), state, state_len) &&
+		snap_copy(f, SNAP_BASE_RAM, 0);
+	vm_file_close(f);
+
+	snap_delete(SNAP_DELTA_FILE);
+	return ok;
+}
+
+// Append the pages written back since the last snapshot. Returns the delta file size, 0 on error.
+static VMUINT32 snap_write_delta(const void *state, VMUINT32 state_len) {
+	snap_delta_t d;
+	VMUINT32 p, ofs;
+	VMUINT size = 0;
+	VMFILE f;
+	int ok;
+
+	f = snap_open(SNAP_DELTA_FILE, MODE_APPEND);
+	if (f < 0)
+		f = snap_open(SNAP_DELTA_FILE, MODE_CREATE_ALWAYS_WRITE);
+	if (f < 0)
+		return 0;
+	vm_file_getfilesize(f, &size);
+	ofs = size;
+
+	d.magic = SNAP_DELTA_MAGIC;
+	d.pages = 0;
+	d.state_len = state_len;
+	for (p = 0; p < vram_pages; p++)
+		if (vram_snap_dirty[p >> 5] & (1u << (p & 31)))
+			d.pages++;
+
+	ok = snap_write(f, ofs, &d, sizeof(d)) && snap_write(f, ofs + sizeof(d), state, state_len);
+	ofs += sizeof(d) + state_len;
+
+	for (p = 0; ok && p < vram_pages; p++) {
+		if (!(vram_snap_dirty[p >> 5] & (1u << (p & 31))))
+			continue;
+		*(VMUINT32*)snap_buf = p;
+		vram_store_read(p << VRAM_PAGE_SHIFT, snap_buf + 4, VRAM_PAGE_SIZE);
+		ok = snap_write(f, ofs, snap_buf, VRAM_PAGE_SIZE + 4);
+		ofs += VRAM_PAGE_SIZE + 4;
+	}
+	vm_file_close(f);
+
+	return ok ? ofs : 0;
+}
+
+// Read the delta record header at ofs, 0 if there is no complete record there
+static int snap_next_delta(VMFILE f, VMUINT32 ofs, VMUINT32 size, VMUINT32 state_len, snap_delta_t *d) {
+	if (ofs + sizeof(*d) > size || !snap_read(f, ofs, d, sizeof(*d)))
+		return 0;
+	if (d->magic != SNAP_DELTA_MAGIC || d->state_len != state_len)
+		return 0;
+	if (d->pages > vram_pages || // Cut short by a failed write
+		ofs + sizeof(*d) + state_len + d->pages * (VRAM_PAGE_SIZE + 4) > size)
+		return 0;
+	return 1;
+}
+
+// Take a snapshot of guest RAM and state. The first one in a session writes a full base.
+int snap_save(const void *state, VMUINT32 state_len) {
+	VMUINT32 size;
+	int ok;
+
+	if (sizeof(snap_header_t) + state_len > SNAP_BASE_RAM || !snap_buf_get())
+		return 0;
+
+	vram_flush(); // Every page changed since the last snapshot is now marked and in the backing store
+	if (snap_valid) {
+		size = snap_write_delta(state, state_len);
+		ok = size != 0;
+	} else {
+		ok = snap_write_base(state, state_len);
+		size = 0;
+	}
+	snap_buf_put();
+
+	// After a failed write the files can't be trusted, start over with a new base next time
+	snap_valid = ok;
+	if (ok) {
+		vram_snap_clear();
+		if (size > SNAP_COMPACT_SIZE && !vram_lazy_count) // Not while RAM is still read from the base
+			snap_compact();
+	}
+	return ok;
+}
+
+// Fold the deltas into the base and delete them
+int snap_compact(void) {
+	snap_header_t h;
+	snap_delta_t d;
+	VMFILE base, f;
+	VMUINT size = 0;
+	VMUINT32 ofs = 0, i, page;
+	int ok = 1;
+
+	base = snap_open(SNAP_FILE, MODE_APPEND);
+	if (base < 0)
+		return 0;
+	f = snap_open(SNAP_DELTA_FILE, MODE_READ);
+	if (f < 0 || !snap_buf_get() || !snap_read(base, 0, &h, sizeof(h))) {
+		if (f >= 0)
+			vm_file_close(f);
+		vm_file_close(base);
+		return 0;
+	}
+	vm_file_getfilesize(f, &size);
+
+	while (ok && snap_next_delta(f, ofs, size, h.state_len, &d)) {
+		// Latest state wins, it's small enough to go through the page buffer
+		ok = snap_read(f, ofs + sizeof(d), snap_buf, d.state_len) &&
+			snap_write(base, sizeof(h), snap_buf, d.state_len);
+		ofs += sizeof(d) + d.state_len;
+
+		for (i = 0; ok && i < d.pages; i++) {
+			ok = snap_read(f, ofs, snap_buf, VRAM_PAGE_SIZE + 4);
+			page = *(VMUINT32*)snap_buf;
+			ok = ok && page < h.pages &&
+				snap_write(base, SNAP_BASE_RAM + (page << VRAM_PAGE_SHIFT), snap_buf + 4, VRAM_PAGE_SIZE);
+			ofs += VRAM_PAGE_SIZE + 4;
+		}
+	}
+
+	vm_file_close(f);
+	vm_file_close(base);
+	snap_buf_put();
+	if (ok)
+		snap_delete(SNAP_DELTA_FILE);
+	return ok;
+}
+
+// Restore the latest snapshot and its state. Returns 0 if there is none.
+// The base isn't copied: guest RAM reads from it until each page is written, see vram_lazy_begin().
+// Only the pages in the deltas go into the backing store now.
+int snap_load(void *state, VMUINT32 state_len) {
+	snap_header_t h;
+	snap_delta_t d;
+	VMFILE f;
+	VMUINT size = 0;
+	VMUINT32 ofs = 0, i, page;
+	int ok;
+
+	f = snap_open(SNAP_FILE, MODE_READ);
+	if (f < 0)
+		return 0;
+	if (!snap_read(f, 0, &h, sizeof(h)) || h.magic != SNAP_MAGIC || h.version != SNAP_VERSION ||
+		h.page_shift != VRAM_PAGE_SHIFT || h.pages != vram_pages || h.state_len != state_len ||
+		!snap_buf_get()) {
+		vm_file_close(f);
+		return 0;
+	}
+
+	ok = snap_read(f, sizeof(h), state, state_len);
+	if (!ok || !vram_lazy_begin(f, SNAP_BASE_RAM)) {
+		// No memory for the page bitmap, copy the whole base instead
+		ok = ok && snap_copy(f, SNAP_BASE_RAM, 1);
+		vm_file_close(f);
+	}
+
+	f = snap_open(SNAP_DELTA_FILE, MODE_READ);
+	if (ok && f >= 0) {
+		vm_file_getfilesize(f, &size);
+		while (ok && snap_next_delta(f, ofs, size, state_len, &d)) {
+			ok = snap_read(f, ofs + sizeof(d), state, state_len);
+			ofs += sizeof(d) + state_len;
+
+			for (i = 0; ok && i < d.pages; i++) {
+				ok = snap_read(f, ofs, snap_buf, VRAM_PAGE_SIZE + 4);
+				page = *(VMUINT32*)snap_buf;
+				ok = ok && page < vram_pages &&
+					vram_store_write(page << VRAM_PAGE_SHIFT, snap_buf + 4, VRAM_PAGE_SIZE);
+				if (ok)
+					vram_lazy_drop(page);
+				ofs += VRAM_PAGE_SIZE + 4;
+			}
+		}
+	}
+	if (f >= 0)
+		vm_file_close(f);
+	snap_buf_put();
+
+	// The backing store now matches the snapshot, whatever was cached is stale
+	vram_reload();
+	vram_snap_clear();
+	snap_valid = ok;
+	return ok;
+}
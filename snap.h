@@ -0,0 +1,65 @@
+#pragma once
+#include "vmsys.h"
+#include "vmio.h"
+
+/*
+ * Snapshots of the whole machine: guest RAM plus a blob of SoC state.
+ *
+ * SNAP_FILE is the base: a header, the state, then a full copy of guest RAM
+ * from offset SNAP_BASE_RAM. Every later snapshot appends a record to
+ * SNAP_DELTA_FILE with the state and only the pages written back to the
+ * backing store since the snapshot before, as tracked by vram_snap_dirty:
+ *
+ *   snap_delta_t    magic, page count, state length
+ *   state
+ *   page records    VMUINT32 guest page number, then the page
+ *
+ * Restoring replays the records into the backing store in order and leaves the
+ * base open as a read-only image that guest pages are faulted in from, so
+ * the guest runs again without copying 12 MiB first. Once the delta file passes SNAP_COMPACT_SIZE its pages are folded
+ * into the base and it is deleted. Replaying a delta that was already folded
+ * in gives the same RAM, so an interrupted compaction loses nothing.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SNAP_FILE "e:\\rv32ima\\snap.bin"
+#define SNAP_DELTA_FILE "e:\\rv32ima\\snap.dlt"
+
+#define SNAP_MAGIC 0x50414e53                 // "SNAP"
+#define SNAP_DELTA_MAGIC 0x544c4453           // "SDLT"
+#define SNAP_VERSION 1
+#define SNAP_BASE_RAM 4096                    // Offset of guest RAM in SNAP_FILE, header and state must fit below
+
+#ifndef SNAP_COMPACT_SIZE
+#define SNAP_COMPACT_SIZE (4 * 1024 * 1024)   // Fold the deltas into the base past this size
+#endif
+#ifndef SNAP_CHUNK
+#define SNAP_CHUNK (64 * 1024)                // Copy buffer, halved down to one page if the heap is short
+#endif
+
+typedef struct {
+	VMUINT32 magic;                           // SNAP_MAGIC
+	VMUINT32 version;
+	VMUINT32 page_shift;                      // VRAM_PAGE_SHIFT of the writer
+	VMUINT32 pages;                           // Guest RAM size in pages
+	VMUINT32 state_len;
+} snap_header_t;
+
+typedef struct {
+	VMUINT32 magic;                           // SNAP_DELTA_MAGIC
+	VMUINT32 pages;                           // Page records after the state
+	VMUINT32 state_len;
+} snap_delta_t;
+
+extern int snap_valid;                        // vram_snap_dirty holds every change since the last snapshot on the card
+
+int snap_save(const void *state, VMUINT32 state_len);
+int snap_load(void *state, VMUINT32 state_len);
+int snap_compact(void);
+
+#ifdef __cplusplus
+}
+#endif
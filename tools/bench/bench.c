@@ -0,0 +1,624 @@
+/*
+ * Headless host benchmark for mrv32.
+ *
+ * Runs MiniRV32IMAStep() with the same core options, page cache and devices
+ * as main.c, minus the screen and the JIT (ARM only), and reports MIPS, the
+ * perf.h counters and wall time. The RAM image, raw or a boot image from
+ * tools/mkimg, is a read-only base: writes go to an overlay file made
+ * afresh each run, so every run starts the same.
+ *
+ *   bench [options] vram.bin
+ *     -s state.bin   resume from a saved state, else boot from the start of RAM
+ *     -k keys.txt    typed into the guest's console
+ *     -w text        hold the keys back until the guest has printed text
+ *     -e text        stop once the guest has printed text
+ *     -n count       stop after count instructions
+ *     -t             guest time follows the host clock, not the instruction count
+ *     -i count       instructions per MiniRV32IMAStep() call, 2048 as on the phone
+ *     -c pages       page cache size, VRAM_PAGE_COUNT by default
+ *     -m bytes       resident RAM, 0 for none, RESIDENT_RAM_MAX by default
+ *     -d disk.img    block device image, read-only
+ *     -o file        overlay file, bench.cow by default
+ *     -r trace       record every step's guest time and input to trace
+ *     -p trace       replay trace instead, and check every step ends the same
+ *     -q             don't echo the guest's output
+ *
+ * A trace is bench_trace_hdr_t, then a bench_trace_rec_t per step, each
+ * followed by the bytes typed in before that step. Guest time and input
+ * are all that isn't decided by the guest, so replaying them gives the same
+ * instructions in any build. Each record ends with the PC and a hash of
+ * the registers after its step; the first one that differs is reported.
+ */
+
+#include "vmsys.h"
+#include "vram.h"
+#include "mmio.h"
+#include "uart.h"
+#include "plic.h"
+#include "pvcon.h"
+#include "vblk.h"
+#include "ring.h"
+#include "perf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_RAM_SIZE 12582912               // RAM_SIZE in main.c, for raw images
+#define BENCH_DTB_SIZE 2048                   // DTB_SIZE and DTB_SIZE_LEGACY in main.c
+#define BENCH_DTB_SIZE_LEGACY 1536
+#define BENCH_RESIDENT_MAX (4 * 1024 * 1024)  // RESIDENT_RAM_MAX and RESIDENT_RAM_HIGH in main.c
+#define BENCH_RESIDENT_HIGH (64 * 1024)
+#define BENCH_STEP 2048                       // INSTRS_PER_FLIP on the phone
+#define BENCH_OVERLAY "bench.cow"
+
+#define BENCH_SERIAL_SIZE 4096                // SERIAL_IN_SIZE in Console_io.h
+#define BENCH_INPUT_MAX 256                   // Most bytes typed in before one step
+#define BENCH_TAIL 64                         // Longest -w / -e text
+
+// Devices the core used to decode itself, as in main.c
+#define CLINT_BASE 0x11000000
+#define CLINT_SIZE 0x10000
+#define SYSCON_BASE 0x11100000
+#define SYSCON_SIZE 0x1000
+
+#define BENCH_TRACE_MAGIC 0x5456524d          // "MRVT"
+#define BENCH_TRACE_VERSION 1
+
+typedef struct {
+	VMUINT32 magic;                           // BENCH_TRACE_MAGIC
+	VMUINT32 version;
+	VMUINT32 ram_size;
+	VMUINT32 step;                            // Instructions per MiniRV32IMAStep() call
+	VMUINT32 wallclock;                       // Recorded with -t
+} bench_trace_hdr_t;
+
+typedef struct {
+	VMUINT32 elapsed;                         // Timer ticks handed to the step
+	VMUINT32 pc;                              // After the step
+	VMUINT32 hash;                            // bench_hash() after the step
+	VMUINT16 input;                           // Bytes typed in before the step, they follow the record
+	VMUINT16 ret;                             // What the step returned
+} bench_trace_rec_t;
+
+static VMUINT32 store4(VMUINT32 ofs, VMUINT32 val);
+static VMUINT16 store2(VMUINT32 ofs, VMUINT16 val);
+static VMUINT8 store1(VMUINT32 ofs, VMUINT8 val);
+static VMUINT32 load4(VMUINT32 ofs);
+static VMUINT16 load2(VMUINT32 ofs);
+static VMUINT8 load1(VMUINT32 ofs);
+static VMUINT32 *amo_ptr(VMUINT32 ofs);
+void console_str_in(const char *str);
+
+static VMUINT32 bench_ram_size = BENCH_RAM_SIZE;
+static vram_img_t bench_img;
+static int bench_boot_img;                    // bench_img holds the header of a boot image
+
+// Same core as main.c
+#define MINIRV32WARN( x ) console_str_in( x );
+#define MINIRV32_DECORATE static
+#define MINI_RV32_RAM_SIZE bench_ram_size
+#define MINIRV32_IMPLEMENTATION
+#define MINIRV32_POSTEXEC( pc, ir, retval ) { PERF_INC(perf.insn[(ir >> 2) & 31]); }
+#define MINIRV32_CUSTOM_MMIO
+#define MINIRV32_HANDLE_MEM_STORE_CONTROL( addy, val ) if( mmio_store( addy, val ) ) { SETCSR( pc, pc + ilen ); return val; }
+#define MINIRV32_HANDLE_MEM_LOAD_CONTROL( addy, rval ) rval = mmio_load( addy );
+#define MINIRV32_OTHERCSR_WRITE( csrno, value ) bench_csr_write( csrno, value );
+#define MINIRV32_TRAP( trap ) { if( trap & 0x80000000 ) PERF_INC(perf.interrupts); else PERF_INC(perf.traps); }
+#define MINIRV32_DECODE_CACHE
+#define MINIRV32_RVC
+#ifndef MINIRV32_SWITCH_DISPATCH
+#define MINIRV32_THREADED_DISPATCH
+#endif
+
+#define MINIRV32_CUSTOM_MEMORY_BUS
+#define MINIRV32_STORE4( ofs, val ) store4(ofs, val)
+#define MINIRV32_STORE2( ofs, val ) store2(ofs, val)
+#define MINIRV32_STORE1( ofs, val ) store1(ofs, val)
+#define MINIRV32_LOAD4( ofs ) load4(ofs)
+#define MINIRV32_LOAD2_SIGNED( ofs ) (VMINT16)load2(ofs)
+#define MINIRV32_LOAD2( ofs ) load2(ofs)
+#define MINIRV32_LOAD1_SIGNED( ofs ) (VMINT8)load1(ofs)
+#define MINIRV32_LOAD1( ofs ) load1(ofs)
+#define MINIRV32_AMO_PTR( ofs ) amo_ptr(ofs)
+
+static void bench_csr_write(VMUINT16 csrno, VMUINT32 value);
+
+#include "mini-rv32ima.h"
+
+vm_file_seek_t vm_file_seek_opt = vm_file_seek;
+vm_file_read_t vm_file_read_opt = vm_file_read;
+vm_file_write_t vm_file_write_opt = vm_file_write;
+
+ring_t serial_in;
+static char serial_in_buf[BENCH_SERIAL_SIZE];
+
+static struct MiniRV32IMAState *core;
+static uint64_t lastTime;
+
+// Options
+static const char *bench_wait, *bench_end;
+static int bench_quiet, bench_wallclock;
+static VMUINT32 bench_step = BENCH_STEP;
+
+// Input still to type, and output seen so far
+static char *bench_keys;
+static VMUINT32 bench_keys_len, bench_keys_pos;
+static char bench_tail[BENCH_TAIL + 1];
+static int bench_waited, bench_ended;
+
+// Host time skipped over while the guest waited for the timer, with -t
+static VMUINT32 bench_skew, bench_last_tick;
+
+// Loads and stores, straight to the page cache
+
+static VMUINT32 store4(VMUINT32 ofs, VMUINT32 val) {
+	PERF_INC(perf.stores);
+	vram_store4(ofs, val);
+	return val;
+}
+
+static VMUINT16 store2(VMUINT32 ofs, VMUINT16 val) {
+	PERF_INC(perf.stores);
+	vram_store2(ofs, val);
+	return val;
+}
+
+static VMUINT8 store1(VMUINT32 ofs, VMUINT8 val) {
+	PERF_INC(perf.stores);
+	vram_store1(ofs, val);
+	return val;
+}
+
+static VMUINT32 load4(VMUINT32 ofs) {
+	VMUINT32 val;
+	PERF_INC(perf.loads);
+	if (mmio_patched(ofs, &val))
+		return val;
+	return vram_load4(ofs);
+}
+
+static VMUINT16 load2(VMUINT32 ofs) {
+	PERF_INC(perf.loads);
+	return vram_load2(ofs);
+}
+
+static VMUINT8 load1(VMUINT32 ofs) {
+	PERF_INC(perf.loads);
+	return vram_load1(ofs);
+}
+
+static VMUINT32 *amo_ptr(VMUINT32 ofs) {
+	VMUINT32 val;
+	if (mmio_patched(ofs, &val))
+		return NULL;
+	PERF_INC(perf.loads);
+	PERF_INC(perf.stores);
+	return (VMUINT32*)vram_ptr_w(ofs);
+}
+
+// Guest output: echoed, and watched for -w and -e
+void console_str_with_length_in(const char *str, int length) {
+	size_t n;
+	int i;
+
+	PERF_TIME_BEGIN(t);
+	if (!bench_quiet)
+		fwrite(str, 1, length, stdout);
+	for (i = 0; i < length; i++) {
+		memmove(bench_tail, bench_tail + 1, BENCH_TAIL - 1);
+		bench_tail[BENCH_TAIL - 1] = str[i];
+		if (bench_wait && !bench_waited) {
+			n = strlen(bench_wait);
+			bench_waited = !memcmp(bench_tail + BENCH_TAIL - n, bench_wait, n);
+		}
+		if (bench_end && !bench_ended) {
+			n = strlen(bench_end);
+			bench_ended = !memcmp(bench_tail + BENCH_TAIL - n, bench_end, n);
+		}
+	}
+	PERF_TIME_END(t, perf.ms_console);
+}
+
+void console_str_in(const char *str) {
+	console_str_with_length_in(str, (int)strlen(str));
+}
+
+static void bench_csr_write(VMUINT16 csrno, VMUINT32 value) {
+	char out[32];
+	if (csrno == 0x136)
+		sprintf(out, "%d", value), console_str_in(out);
+	if (csrno == 0x137)
+		sprintf(out, "%08x", value), console_str_in(out);
+}
+
+// Devices, wired as in main.c
+
+static void bench_irq_update(void) {
+	plic_set_irq(UART_IRQ, uart_irq());
+	plic_set_irq(PVCON_IRQ, pvcon_irq());
+	plic_set_irq(VBLK_IRQ, vblk_irq());
+	if (plic_meip())
+		core->mip |= 1 << 11;
+	else
+		core->mip &= ~(1 << 11);
+}
+
+static VMUINT32 bench_uart_load(VMUINT32 ofs) {
+	VMUINT32 val = uart_load(ofs);
+	bench_irq_update();
+	return val;
+}
+
+static int bench_uart_store(VMUINT32 ofs, VMUINT32 val) {
+	uart_store(ofs, val);
+	bench_irq_update();
+	return 0;
+}
+
+static int bench_pvcon_store(VMUINT32 ofs, VMUINT32 val) {
+	pvcon_store(ofs, val);
+	bench_irq_update();
+	return 0;
+}
+
+static int bench_vblk_store(VMUINT32 ofs, VMUINT32 val) {
+	vblk_store(ofs, val);
+	bench_irq_update();
+	return 0;
+}
+
+static void bench_dma_written(VMUINT32 ofs, VMUINT32 len) {
+	MiniRV32IMAInvalidateCode(ofs, len);
+}
+
+static VMUINT32 bench_plic_load(VMUINT32 ofs) {
+	VMUINT32 val = plic_load(ofs);
+	bench_irq_update();
+	return val;
+}
+
+static int bench_plic_store(VMUINT32 ofs, VMUINT32 val) {
+	plic_store(ofs, val);
+	bench_irq_update();
+	return 0;
+}
+
+static VMUINT32 bench_clint_load(VMUINT32 ofs) {
+	if (ofs == 0xbffc)
+		return core->timerh;
+	if (ofs == 0xbff8)
+		return core->timerl;
+	return 0;
+}
+
+static int bench_clint_store(VMUINT32 ofs, VMUINT32 val) {
+	if (ofs == 0x4004)
+		core->timermatchh = val;
+	else if (ofs == 0x4000)
+		core->timermatchl = val;
+	return 0;
+}
+
+static int bench_syscon_store(VMUINT32 ofs, VMUINT32 val) {
+	(void)val; // Power off and restart codes, the bench stops on -e, -n or the end of a trace
+	return ofs == 0;
+}
+
+static void bench_mmio_init(void) {
+	mmio_register(UART_BASE, UART_SIZE, "uart", bench_uart_load, bench_uart_store);
+	mmio_register(PVCON_BASE, PVCON_SIZE, "pvcon", pvcon_load, bench_pvcon_store);
+	mmio_register(VBLK_BASE, VBLK_SIZE, "vblk", vblk_load, bench_vblk_store);
+	mmio_register(PLIC_BASE, PLIC_SIZE, "plic", bench_plic_load, bench_plic_store);
+	mmio_register(CLINT_BASE, CLINT_SIZE, "clint", bench_clint_load, bench_clint_store);
+	mmio_register(SYSCON_BASE, SYSCON_SIZE, "syscon", NULL, bench_syscon_store);
+	mmio_patch_add(0xB8, 0xFEE6DCE3);
+}
+
+// Guest time, as soc_elapsed() and soc_wfi() in main.c. With -t the host clock
+// runs on by bench_skew instead of sleeping through WFI.
+
+static VMUINT32 bench_elapsed(uint64_t ccount) {
+	VMUINT32 ticks = (VMUINT32)(ccount - lastTime), now, gap;
+
+	lastTime += ticks;
+	if (bench_wallclock) {
+		now = host_ms() + bench_skew;
+		gap = now - bench_last_tick;
+		if (gap > 1000)
+			gap = 1000;
+		bench_last_tick = now;
+		ticks = gap * 1000;
+	}
+	return ticks;
+}
+
+// Cycle counter of the core, as soc_cycles() in main.c reads it
+static uint64_t bench_cycles(void) {
+	return ((uint64_t)core->cycleh << 32) | core->cyclel;
+}
+
+static void bench_wfi(void) {
+	uint64_t timer = ((uint64_t)core->timerh << 32) | core->timerl;
+	uint64_t match = ((uint64_t)core->timermatchh << 32) | core->timermatchl;
+	uint64_t delta;
+
+	if (match == 0) {
+		delta = bench_wallclock ? 0 : bench_step;
+	} else if (match >= timer) {
+		delta = match - timer + 1;
+		if (bench_wallclock) {
+			bench_skew += (VMUINT32)((delta + 999) / 1000);
+			delta = 0;
+		}
+	} else {
+		delta = 0;
+	}
+	delta += bench_cycles();
+	core->cyclel = (uint32_t)delta;
+	core->cycleh = (uint32_t)(delta >> 32);
+}
+
+// Registers, PC and cycle count
+static VMUINT32 bench_hash(void) {
+	VMUINT32 h = 2166136261u, i;
+	const VMUINT8 *p = (const VMUINT8*)core->regs;
+
+	for (i = 0; i < sizeof(core->regs); i++)
+		h = (h ^ p[i]) * 16777619u;
+	return (h ^ core->pc ^ core->cyclel) * 16777619u;
+}
+
+// Type in what fits before the next step
+static VMUINT32 bench_feed(char *in) {
+	VMUINT32 n = bench_keys_len - bench_keys_pos;
+
+	if (bench_wait && !bench_waited)
+		return 0;
+	if (n > BENCH_INPUT_MAX)
+		n = BENCH_INPUT_MAX;
+	if (n > ring_space(&serial_in))
+		n = ring_space(&serial_in);
+	memcpy(in, bench_keys + bench_keys_pos, n);
+	bench_keys_pos += n;
+	return n;
+}
+
+static char *bench_slurp(const char *path, VMUINT32 *len) {
+	FILE *f = fopen(path, "rb");
+	char *data;
+	long n;
+
+	if (f == NULL)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	n = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = (char*)malloc(n + 1);
+	*len = (VMUINT32)fread(data, 1, n, f);
+	fclose(f);
+	return data;
+}
+
+// As load_man() in main.c
+static int bench_resume(const char *path) {
+	FILE *f = fopen(path, "rb");
+
+	if (f == NULL || fread(core, sizeof(*core), 1, f) != 1 || fread(&lastTime, sizeof(lastTime), 1, f) != 1)
+		return 0;
+	if (fread(&uart, sizeof(uart), 1, f) != 1) {
+		uart_reset();
+		uart.ier = 0x05;
+	}
+	if (fread(&plic, sizeof(plic), 1, f) != 1)
+		plic_reset();
+	if (fread(&pvcon, sizeof(pvcon), 1, f) != 1)
+		pvcon_reset();
+	if (fread(&vblk, sizeof(vblk), 1, f) != 1)
+		vblk_reset();
+	fclose(f);
+	MiniRV32IMAFlushDecodeCache();
+	return 1;
+}
+
+static void bench_boot(void) {
+	core->pc = MINIRV32_RAM_IMAGE_OFFSET;
+	core->regs[10] = 0x00;
+	if (bench_boot_img) {
+		core->regs[11] = bench_img.dtb_ofs;
+	} else {
+		core->regs[11] = bench_ram_size - sizeof(struct MiniRV32IMAState) - BENCH_DTB_SIZE;
+		if (load4(core->regs[11]) != 0xedfe0dd0)
+			core->regs[11] = bench_ram_size - sizeof(struct MiniRV32IMAState) - BENCH_DTB_SIZE_LEGACY;
+	}
+	core->regs[11] += MINIRV32_RAM_IMAGE_OFFSET;
+	core->extraflags |= 3;
+}
+
+static int bench_usage(void) {
+	fprintf(stderr, "usage: bench [-s state] [-k keys] [-w text] [-e text] [-n count] [-t] [-i count]\n"
+		"             [-c pages] [-m bytes] [-d disk] [-o overlay] [-r trace | -p trace] [-q] vram.bin\n");
+	return 2;
+}
+
+int main(int argc, char **argv) {
+	const char *state = NULL, *keys = NULL, *disk = NULL, *overlay = BENCH_OVERLAY, *record = NULL, *replay = NULL;
+	VMUINT32 pages = VRAM_PAGE_COUNT, resident = BENCH_RESIDENT_MAX, start, ms, elapsed, steps = 0;
+	uint64_t max = 0, executed = 0, before;
+	bench_trace_hdr_t hdr;
+	bench_trace_rec_t rec;
+	char in[BENCH_INPUT_MAX], line[PERF_LINE];
+	const char *why = "trace end";
+	FILE *trace = NULL;
+	VMFILE base, ram;
+	int i, ret = 0, diverged = 0;
+
+	for (i = 1; i < argc - 1 && argv[i][0] == '-'; i++) {
+		switch (argv[i][1]) {
+		case 't': bench_wallclock = 1; continue;
+		case 'q': bench_quiet = 1; continue;
+		}
+		if (i + 1 >= argc - 1)
+			return bench_usage();
+		switch (argv[i][1]) {
+		case 's': state = argv[++i]; break;
+		case 'k': keys = argv[++i]; break;
+		case 'w': bench_wait = argv[++i]; break;
+		case 'e': bench_end = argv[++i]; break;
+		case 'n': max = strtoull(argv[++i], NULL, 0); break;
+		case 'i': bench_step = strtoul(argv[++i], NULL, 0); break;
+		case 'c': pages = strtoul(argv[++i], NULL, 0); break;
+		case 'm': resident = strtoul(argv[++i], NULL, 0); break;
+		case 'd': disk = argv[++i]; break;
+		case 'o': overlay = argv[++i]; break;
+		case 'r': record = argv[++i]; break;
+		case 'p': replay = argv[++i]; break;
+		default: return bench_usage();
+		}
+	}
+	if (i != argc - 1 || (record && replay) || bench_step == 0 ||
+		(bench_wait && strlen(bench_wait) > BENCH_TAIL) || (bench_end && strlen(bench_end) > BENCH_TAIL))
+		return bench_usage();
+	memset(bench_tail, ' ', BENCH_TAIL);
+
+	if (keys && (bench_keys = bench_slurp(keys, &bench_keys_len)) == NULL) {
+		fprintf(stderr, "bench: can't read %s\n", keys);
+		return 1;
+	}
+	// Guest RAM over the image, as main.c does with base.bin
+	base = host_open(argv[i], MODE_READ);
+	ram = host_open(overlay, MODE_CREATE_ALWAYS_WRITE);
+	if (base < 0 || ram < 0) {
+		fprintf(stderr, "bench: can't open %s\n", base < 0 ? argv[i] : overlay);
+		return 1;
+	}
+	bench_boot_img = vram_img_probe(base, &bench_img);
+	if (bench_boot_img)
+		bench_ram_size = bench_img.ram_size;
+
+	if (replay) {
+		trace = fopen(replay, "rb");
+		if (trace == NULL || fread(&hdr, sizeof(hdr), 1, trace) != 1 || hdr.magic != BENCH_TRACE_MAGIC ||
+			hdr.version != BENCH_TRACE_VERSION || hdr.ram_size != bench_ram_size) {
+			fprintf(stderr, "bench: %s isn't a trace for this build\n", replay);
+			return 1;
+		}
+		bench_step = hdr.step;
+		bench_wallclock = hdr.wallclock;
+	} else if (record) {
+		trace = fopen(record, "wb");
+		if (trace == NULL) {
+			fprintf(stderr, "bench: can't write %s\n", record);
+			return 1;
+		}
+		hdr.magic = BENCH_TRACE_MAGIC;
+		hdr.version = BENCH_TRACE_VERSION;
+		hdr.ram_size = bench_ram_size;
+		hdr.step = bench_step;
+		hdr.wallclock = bench_wallclock;
+		fwrite(&hdr, sizeof(hdr), 1, trace);
+	}
+
+	if (!vram_init(ram, bench_ram_size, pages) || !vram_overlay_begin(base)) {
+		fprintf(stderr, "bench: no memory for the page cache\n");
+		return 1;
+	}
+	if (resident)
+		vram_init_resident(resident, BENCH_RESIDENT_HIGH);
+
+	ring_init(&serial_in, serial_in_buf, BENCH_SERIAL_SIZE);
+	uart_reset();
+	plic_reset();
+	pvcon_init(bench_ram_size, bench_dma_written);
+	vblk_init(bench_ram_size, bench_dma_written);
+	if (disk) {
+		VMFILE d = host_open(disk, MODE_READ);
+		if (d >= 0)
+			vblk_open(d, 1);
+	}
+	bench_mmio_init();
+
+	core = (struct MiniRV32IMAState*)calloc(1, sizeof(*core));
+	if (state) {
+		if (!bench_resume(state)) {
+			fprintf(stderr, "bench: can't read %s\n", state);
+			return 1;
+		}
+	} else {
+		bench_boot();
+	}
+
+	perf_reset();
+	start = bench_last_tick = host_ms();
+	for (;;) {
+		if (replay) {
+			if (fread(&rec, sizeof(rec), 1, trace) != 1 || rec.input > BENCH_INPUT_MAX ||
+				fread(in, 1, rec.input, trace) != rec.input)
+				break;
+			elapsed = rec.elapsed;
+			bench_elapsed(bench_cycles()); // Keeps lastTime in step
+		} else {
+			rec.input = (VMUINT16)bench_feed(in);
+			elapsed = bench_elapsed(bench_cycles());
+		}
+		ring_push(&serial_in, in, rec.input);
+
+		if (!pvcon_poll())
+			uart_poll();
+		bench_irq_update();
+
+		before = bench_cycles();
+		ret = MiniRV32IMAStep(core, NULL, 0, elapsed, bench_step);
+		executed += bench_cycles() - before; // Before WFI moves it on
+		uart_tx_flush();
+		if (ret == 1)
+			bench_wfi();
+		steps++;
+
+		if (replay) {
+			if (rec.pc != core->pc || rec.hash != bench_hash() || rec.ret != (VMUINT16)ret) {
+				fprintf(stderr, "\nbench: step %u diverged at cycle %llu: pc %08x hash %08x ret %d, trace has pc %08x hash %08x ret %d\n",
+					steps - 1, (unsigned long long)before, core->pc, bench_hash(), ret, rec.pc, rec.hash, rec.ret);
+				diverged = 1;
+				why = "divergence";
+				break;
+			}
+		} else {
+			if (record) {
+				rec.elapsed = elapsed;
+				rec.pc = core->pc;
+				rec.hash = bench_hash();
+				rec.ret = (VMUINT16)ret;
+				fwrite(&rec, sizeof(rec), 1, trace);
+				fwrite(in, 1, rec.input, trace);
+			}
+			if (bench_ended) {
+				why = "end text";
+				break;
+			}
+			if (max && executed >= max) {
+				why = "instruction limit";
+				break;
+			}
+		}
+		if (ret != 0 && ret != 1) {
+			why = ret == 0x5555 ? "poweroff" : ret == 0x7777 ? "restart" : "step failure";
+			break;
+		}
+	}
+	ms = host_ms() - start;
+
+	if (trace)
+		fclose(trace);
+	vram_deinit();
+	vm_file_close(ram);
+	remove(overlay);
+
+	fflush(stdout);
+	PERF_ADD(perf.ms_run, ms);
+	fprintf(stderr, "\nbench: stopped by %s after %u steps\n", why, steps);
+	fprintf(stderr, "bench: %llu instructions in %u ms, %.2f MIPS, %s dispatch\n", (unsigned long long)executed, ms,
+		ms ? (double)executed / ms / 1000 : 0.0, MINIRV32_DISPATCH_NAME);
+	for (i = 0; perf_line(i, line, 1); i++)
+		fprintf(stderr, "bench: %s\n", line);
+	return diverged;
+}
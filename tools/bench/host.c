@@ -0,0 +1,117 @@
+/*
+ * MRE calls on the host for the bench, see vmsys.h.
+ * Files are stdio streams in a small handle table, paths are taken as
+ * plain ASCII.
+ */
+
+#include "vmsys.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define HOST_MAX_FILES 16
+
+static FILE *host_files[HOST_MAX_FILES];
+static char host_writing[HOST_MAX_FILES];     // stdio wants a seek between a write and a read, and back
+
+void *vm_malloc(int size) { return malloc(size); }
+void *vm_calloc(int size) { return calloc(1, size); }
+void vm_free(void *ptr) { free(ptr); }
+
+VMUINT32 host_ms(void) {
+#ifdef _WIN32
+	return GetTickCount();
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (VMUINT32)(t.tv_sec * 1000 + t.tv_nsec / 1000000);
+#endif
+}
+
+VMUINT32 vm_get_tick_count(void) {
+	return host_ms();
+}
+
+VMINT vm_gb2312_to_ucs2(VMWCHAR *dst, VMINT size, VMCHAR *src) {
+	VMINT i;
+	for (i = 0; src[i] && (i + 1) * 2 < size; i++)
+		dst[i] = (unsigned char)src[i];
+	dst[i] = 0;
+	return 0;
+}
+
+static void host_path(const VMWCHAR *w, char *path, int size) {
+	int i;
+	for (i = 0; w[i] && i < size - 1; i++)
+		path[i] = (char)w[i];
+	path[i] = 0;
+}
+
+// Same modes as vm_file_open: MODE_APPEND opens an existing file for reading and writing
+VMFILE host_open(const char *path, VMUINT mode) {
+	const char *m = mode == MODE_READ ? "rb" : mode == MODE_CREATE_ALWAYS_WRITE ? "w+b" : "r+b";
+	VMFILE h;
+
+	for (h = 0; h < HOST_MAX_FILES && host_files[h]; h++)
+		;
+	if (h == HOST_MAX_FILES || (host_files[h] = fopen(path, m)) == NULL)
+		return -1;
+	host_writing[h] = 0;
+	return h;
+}
+
+VMFILE vm_file_open(const VMWCHAR *filename, VMUINT mode, VMUINT binary) {
+	char path[260];
+	(void)binary; // Always binary
+	host_path(filename, path, sizeof(path));
+	return host_open(path, mode);
+}
+
+void vm_file_close(VMFILE handle) {
+	fclose(host_files[handle]);
+	host_files[handle] = NULL;
+}
+
+VMINT vm_file_read(VMFILE handle, void *data, VMUINT length, VMUINT *nread) {
+	if (host_writing[handle])
+		fseek(host_files[handle], 0, SEEK_CUR);
+	host_writing[handle] = 0;
+	*nread = (VMUINT)fread(data, 1, length, host_files[handle]);
+	return *nread;
+}
+
+VMINT vm_file_write(VMFILE handle, void *data, VMUINT length, VMUINT *written) {
+	if (!host_writing[handle])
+		fseek(host_files[handle], 0, SEEK_CUR);
+	host_writing[handle] = 1;
+	*written = (VMUINT)fwrite(data, 1, length, host_files[handle]);
+	return *written;
+}
+
+VMINT vm_file_seek(VMFILE handle, VMINT offset, VMINT base) {
+	int whence = base == BASE_CURR ? SEEK_CUR : base == BASE_END ? SEEK_END : SEEK_SET;
+	return fseek(host_files[handle], offset, whence);
+}
+
+VMINT vm_file_getfilesize(VMFILE handle, VMUINT *file_size) {
+	long pos = ftell(host_files[handle]);
+	fseek(host_files[handle], 0, SEEK_END);
+	*file_size = (VMUINT)ftell(host_files[handle]);
+	fseek(host_files[handle], pos, SEEK_SET);
+	return 0;
+}
+
+VMINT vm_file_commit(VMFILE handle) {
+	return fflush(host_files[handle]);
+}
+
+VMINT vm_file_delete(const VMWCHAR *filename) {
+	char path[260];
+	host_path(filename, path, sizeof(path));
+	return remove(path);
+}
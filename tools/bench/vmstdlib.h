@@ -0,0 +1,2 @@
+#pragma once
+#include "vmsys.h" // Host stand-in, see there
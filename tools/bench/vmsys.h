@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Host stand-in for the parts of the MRE SDK the core modules use, so
+ * vram.c, mmio.c and the devices build unchanged for the bench. The file
+ * calls map to stdio, see host.c. vmio.h, vmchset.h and vmstdlib.h here
+ * only include this file.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef char VMCHAR;
+typedef signed char VMINT8;
+typedef unsigned char VMUINT8;
+typedef short VMINT16;
+typedef unsigned short VMUINT16;
+typedef int VMINT;
+typedef unsigned int VMUINT;
+typedef int VMINT32;
+typedef unsigned int VMUINT32;
+typedef unsigned short VMWCHAR;
+typedef int VMFILE;
+
+#define VM_TRUE 1
+#define VM_FALSE 0
+
+#define MODE_READ 1
+#define MODE_WRITE 2
+#define MODE_CREATE_ALWAYS_WRITE 4
+#define MODE_APPEND 8
+
+#define BASE_BEGIN 1
+#define BASE_CURR 2
+#define BASE_END 3
+
+void *vm_malloc(int size);
+void *vm_calloc(int size);
+void vm_free(void *ptr);
+VMUINT32 vm_get_tick_count(void);
+
+VMINT vm_gb2312_to_ucs2(VMWCHAR *dst, VMINT size, VMCHAR *src);
+VMFILE vm_file_open(const VMWCHAR *filename, VMUINT mode, VMUINT binary);
+void vm_file_close(VMFILE handle);
+VMINT vm_file_read(VMFILE handle, void *data, VMUINT length, VMUINT *nread);
+VMINT vm_file_write(VMFILE handle, void *data, VMUINT length, VMUINT *written);
+VMINT vm_file_seek(VMFILE handle, VMINT offset, VMINT base);
+VMINT vm_file_getfilesize(VMFILE handle, VMUINT *file_size);
+VMINT vm_file_commit(VMFILE handle);
+VMINT vm_file_delete(const VMWCHAR *filename);
+
+// Plain host paths for the bench, without the UCS-2 round trip
+VMFILE host_open(const char *path, VMUINT mode);
+VMUINT32 host_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
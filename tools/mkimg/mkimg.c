@@ -0,0 +1,260 @@
+/*
+ * Host builder for mrv32 boot images, see vram.h.
+ *
+ * Lays out guest RAM the way main.c boots it: the kernel at the start of
+ * RAM (MINIRV32_RAM_IMAGE_OFFSET), the DTB below the core state at the top,
+ * and the memory node of the DTB sized to end where the DTB starts. Only
+ * pages that aren't all zero are stored, and the header tells the emulator
+ * the RAM size and the DTB's place and real size, so nothing has to match
+ * RAM_SIZE or DTB_SIZE in main.c.
+ *
+ *   mkimg [options] Image
+ *     -d file.dtb    compiled DTB (dtc -O dtb mrv32.dts)
+ *     -m bytes       guest RAM size, k and M suffixes, 12M by default
+ *     -r             the input is a whole raw RAM image (vram.bin), DTB
+ *                    and all. With -d its DTB is replaced.
+ *     -o file        output, base.bin by default
+ *
+ * Copy the output to e:\rv32ima\base.bin and delete vram.cow to boot it.
+ */
+
+#include "vmsys.h"
+#include "vram.h"
+#define MINIRV32_DECORATE                     // Only for struct MiniRV32IMAState
+#include "mini-rv32ima.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MKIMG_RAM_SIZE 12582912               // RAM_SIZE in main.c
+#define MKIMG_DTB_SIZE 2048                   // DTB_SIZE and DTB_SIZE_LEGACY in main.c, where raw images have theirs
+#define MKIMG_DTB_SIZE_LEGACY 1536
+#define MKIMG_OUT "base.bin"
+
+#define FDT_MAGIC 0xd00dfeed
+#define FDT_BEGIN_NODE 1
+#define FDT_END_NODE 2
+#define FDT_PROP 3
+#define FDT_NOP 4
+#define FDT_END 9
+
+static VMUINT32 be32(const VMUINT8 *p) {
+	return ((VMUINT32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void set_be32(VMUINT8 *p, VMUINT32 v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static VMUINT8 *slurp(const char *path, VMUINT32 *len) {
+	FILE *f = fopen(path, "rb");
+	VMUINT8 *buf;
+	long n;
+
+	if (f == NULL || fseek(f, 0, SEEK_END) || (n = ftell(f)) < 0 || fseek(f, 0, SEEK_SET)) {
+		if (f)
+			fclose(f);
+		return NULL;
+	}
+	buf = (VMUINT8*)malloc(n ? n : 1);
+	if (buf && fread(buf, 1, n, f) != (size_t)n) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*len = (VMUINT32)n;
+	return buf;
+}
+
+// Size of the FDT at p if it looks like one and fits in len bytes, else 0
+static VMUINT32 fdt_size(const VMUINT8 *p, VMUINT32 len) {
+	VMUINT32 size;
+
+	if (len < 40 || be32(p) != FDT_MAGIC)
+		return 0;
+	size = be32(p + 4);
+	if (size < 40 || size > len || be32(p + 8) >= size || be32(p + 12) > size)
+		return 0;
+	return size;
+}
+
+// Set the size of the first region in the reg of the top level memory node.
+// Returns 0 if there is no such node, or its reg isn't one region or more.
+static int fdt_set_memory(VMUINT8 *fdt, VMUINT32 size) {
+	VMUINT32 total = be32(fdt + 4), p = be32(fdt + 8), strings = be32(fdt + 12);
+	VMUINT32 len, cells_a = 2, cells_s = 1, tok;
+	int depth = 0, memory = 0;
+	const char *name;
+
+	while (p + 4 <= total) {
+		tok = be32(fdt + p);
+		p += 4;
+		switch (tok) {
+		case FDT_BEGIN_NODE:
+			name = (const char*)fdt + p;
+			depth++;
+			memory = depth == 2 && (!strcmp(name, "memory") || !strncmp(name, "memory@", 7));
+			p += (strlen(name) + 4) & ~3;
+			break;
+		case FDT_END_NODE:
+			depth--;
+			memory = 0;
+			break;
+		case FDT_PROP:
+			if (p + 8 > total)
+				return 0;
+			len = be32(fdt + p);
+			if (strings + be32(fdt + p + 4) >= total || p + 8 + len > total)
+				return 0;
+			name = (const char*)fdt + strings + be32(fdt + p + 4);
+			p += 8;
+			if (depth == 1 && len == 4 && !strcmp(name, "#address-cells"))
+				cells_a = be32(fdt + p);
+			else if (depth == 1 && len == 4 && !strcmp(name, "#size-cells"))
+				cells_s = be32(fdt + p);
+			else if (memory && !strcmp(name, "reg")) {
+				if (cells_s < 1 || cells_s > 2 || len < (cells_a + cells_s) * 4)
+					return 0;
+				if (cells_s == 2)
+					set_be32(fdt + p + cells_a * 4, 0);
+				set_be32(fdt + p + (cells_a + cells_s - 1) * 4, size);
+				return 1;
+			}
+			p += (len + 3) & ~3;
+			break;
+		case FDT_NOP:
+			break;
+		default: // FDT_END or garbage
+			return 0;
+		}
+	}
+	return 0;
+}
+
+// Multiplier suffixes as in dd
+static VMUINT32 parse_size(const char *s) {
+	char *end;
+	unsigned long n = strtoul(s, &end, 0);
+
+	if (*end == 'k' || *end == 'K')
+		n <<= 10;
+	else if (*end == 'm' || *end == 'M')
+		n <<= 20;
+	return (VMUINT32)n;
+}
+
+static int usage(void) {
+	fprintf(stderr, "usage: mkimg [-d file.dtb] [-m bytes] [-r] [-o file] Image\n");
+	return 2;
+}
+
+int main(int argc, char **argv) {
+	const char *dtb_path = NULL, *out = MKIMG_OUT;
+	VMUINT32 ram_size = 0, len, dtb_len = 0, pages, p, i, reserve = sizeof(struct MiniRV32IMAState);
+	VMUINT8 *ram, *in, *dtb = NULL;
+	VMUINT16 *index;
+	vram_img_t img;
+	FILE *f;
+	int raw = 0, ok;
+
+	for (i = 1; i < (VMUINT32)argc - 1 && argv[i][0] == '-'; i++) {
+		if (argv[i][1] == 'r') {
+			raw = 1;
+			continue;
+		}
+		if (i + 1 >= (VMUINT32)argc - 1)
+			return usage();
+		switch (argv[i][1]) {
+		case 'd': dtb_path = argv[++i]; break;
+		case 'm': ram_size = parse_size(argv[++i]); break;
+		case 'o': out = argv[++i]; break;
+		default: return usage();
+		}
+	}
+	if (i != (VMUINT32)argc - 1 || (!raw && dtb_path == NULL))
+		return usage();
+
+	in = slurp(argv[i], &len);
+	if (in == NULL) {
+		fprintf(stderr, "mkimg: can't read %s\n", argv[i]);
+		return 1;
+	}
+	if (dtb_path && ((dtb = slurp(dtb_path, &dtb_len)) == NULL || (dtb_len = fdt_size(dtb, dtb_len)) == 0)) {
+		fprintf(stderr, "mkimg: %s isn't a DTB\n", dtb_path);
+		return 1;
+	}
+	if (ram_size == 0)
+		ram_size = raw ? len : MKIMG_RAM_SIZE;
+	ram_size = (ram_size + VRAM_PAGE_MASK) & ~VRAM_PAGE_MASK;
+	pages = ram_size >> VRAM_PAGE_SHIFT;
+	if (pages > VRAM_IMG_MAX_PAGES || len > ram_size || ram_size - (raw ? 0 : len) < reserve + (dtb ? dtb_len : MKIMG_DTB_SIZE)) {
+		fprintf(stderr, "mkimg: %u bytes of RAM don't fit %s\n", ram_size, dtb ? "the image and the DTB" : "the image");
+		return 1;
+	}
+	ram = (VMUINT8*)calloc(1, ram_size);
+	index = (VMUINT16*)calloc(pages, sizeof(VMUINT16));
+	if (ram == NULL || index == NULL) {
+		fprintf(stderr, "mkimg: out of memory\n");
+		return 1;
+	}
+	memcpy(ram, in, len);
+
+	memset(&img, 0, sizeof(img));
+	img.magic = VRAM_IMG_MAGIC;
+	img.version = VRAM_IMG_VERSION;
+	img.page_shift = VRAM_PAGE_SHIFT;
+	img.ram_size = ram_size;
+	if (dtb) {
+		// Below the core state, 8 byte aligned as the FDT wants, and the guest gets all RAM under it
+		img.dtb_ofs = (ram_size - reserve - dtb_len) & ~7;
+		img.dtb_size = dtb_len;
+		if (!raw && len > img.dtb_ofs) {
+			fprintf(stderr, "mkimg: %s runs into the DTB\n", argv[i]);
+			return 1;
+		}
+		if (!fdt_set_memory(dtb, img.dtb_ofs)) {
+			fprintf(stderr, "mkimg: no memory node in %s\n", dtb_path);
+			return 1;
+		}
+		memset(ram + img.dtb_ofs, 0, ram_size - img.dtb_ofs);
+		memcpy(ram + img.dtb_ofs, dtb, dtb_len);
+	} else {
+		// Where main.c looks in a raw image, the memory node is left as it is
+		img.dtb_ofs = ram_size - reserve - MKIMG_DTB_SIZE;
+		img.dtb_size = fdt_size(ram + img.dtb_ofs, ram_size - img.dtb_ofs);
+		if (img.dtb_size == 0) {
+			img.dtb_ofs = ram_size - reserve - MKIMG_DTB_SIZE_LEGACY;
+			img.dtb_size = fdt_size(ram + img.dtb_ofs, ram_size - img.dtb_ofs);
+		}
+		if (img.dtb_size == 0) {
+			fprintf(stderr, "mkimg: no DTB in %s, give one with -d\n", argv[i]);
+			return 1;
+		}
+	}
+
+	for (p = 0; p < pages; p++) {
+		const VMUINT32 *w = (const VMUINT32*)(ram + (p << VRAM_PAGE_SHIFT));
+		for (i = 0; i < VRAM_PAGE_SIZE / 4 && !w[i]; i++)
+			;
+		if (i < VRAM_PAGE_SIZE / 4)
+			index[p] = (VMUINT16)++img.slots;
+	}
+
+	f = fopen(out, "wb");
+	ok = f != NULL && fwrite(&img, sizeof(img), 1, f) == 1 &&
+		!fseek(f, VRAM_IMG_INDEX, SEEK_SET) && fwrite(index, sizeof(VMUINT16), pages, f) == pages &&
+		!fseek(f, VRAM_IMG_DATA(pages), SEEK_SET);
+	for (p = 0; ok && p < pages; p++)
+		if (index[p])
+			ok = fwrite(ram + (p << VRAM_PAGE_SHIFT), VRAM_PAGE_SIZE, 1, f) == 1;
+	if (f == NULL || fclose(f) || !ok) {
+		fprintf(stderr, "mkimg: can't write %s\n", out);
+		return 1;
+	}
+	printf("%s: %u KB RAM, %u of %u pages stored, DTB at 0x%x, %u bytes\n", out, ram_size >> 10,
+		img.slots, pages, img.dtb_ofs + MINIRV32_RAM_IMAGE_OFFSET, img.dtb_size);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * 16550A UART model for mrv32, see uart.h.
+ */
+
+#include "uart.h"
+#include "ring.h"
+#include "perf.h"
+
+// Console_io.h pulls in main.h, which can only be included once per program
+extern ring_t serial_in;
+void console_str_with_length_in(const char* str, int length);
+
+uart_t uart;
+
+// Transmit ring, free running indexes masked on access
+static char uart_tx[UART_TX_SIZE];
+static VMUINT32 uart_tx_head = 0, uart_tx_tail = 0;
+
+void uart_reset(void) {
+	memset(&uart, 0, sizeof(uart));
+}
+
+// Move waiting keyboard input into the RX FIFO, one byte deep with the FIFO off
+void uart_poll(void) {
+	VMUINT32 depth = (uart.fcr & 1) ? UART_FIFO_SIZE : 1;
+	int c;
+
+	while (uart.rx_count < depth && (c = ring_pop1(&serial_in)) >= 0)
+		uart.rx_buf[(uart.rx_head + uart.rx_count++) & (UART_FIFO_SIZE - 1)] = c;
+}
+
+static VMUINT32 uart_iir(void) {
+	VMUINT32 fifo = (uart.fcr & 1) ? 0xc0 : 0;
+
+	if ((uart.ier & 1) && uart.rx_count)
+		return fifo | 0x04; // Received data available
+	if ((uart.ier & 2) && uart.thre)
+		return fifo | 0x02; // THR empty
+	return fifo | 0x01; // Nothing pending
+}
+
+int uart_irq(void) {
+	return !(uart_iir() & 1);
+}
+
+VMUINT32 uart_load(VMUINT32 reg) {
+	int dlab = uart.lcr & 0x80;
+	VMUINT32 val;
+
+	switch (reg) {
+	case 0:
+		if (dlab)
+			return uart.dll;
+		if (uart.rx_count == 0)
+			return 0;
+		val = (VMUINT8)uart.rx_buf[uart.rx_head];
+		uart.rx_head = (uart.rx_head + 1) & (UART_FIFO_SIZE - 1);
+		uart.rx_count--;
+		uart_poll();
+		PERF_LAT(PERF_LAT_READ);
+		return val;
+	case 1: return dlab ? uart.dlm : uart.ier;
+	case 2:
+		val = uart_iir();
+		if ((val & 0x0f) == 0x02)
+			uart.thre = 0; // Reading IIR acknowledges THRE
+		return val;
+	case 3: return uart.lcr;
+	case 4: return uart.mcr;
+	case 5: return 0x60 | (uart.rx_count != 0); // TEMT | THRE | DR
+	case 6: return 0xb0; // DCD | DSR | CTS
+	case 7: return uart.scr;
+	}
+	return 0;
+}
+
+void uart_store(VMUINT32 reg, VMUINT32 val) {
+	int dlab = uart.lcr & 0x80;
+
+	switch (reg) {
+	case 0:
+		if (dlab) {
+			uart.dll = val;
+			break;
+		}
+		if (val & 0xff) { // The terminal never got NULs
+			if (uart_tx_head - uart_tx_tail == UART_TX_SIZE)
+				uart_tx_flush();
+			uart_tx[uart_tx_head++ & (UART_TX_SIZE - 1)] = (char)val;
+		}
+		uart.thre = 1; // Sent right away
+		break;
+	case 1:
+		if (dlab) {
+			uart.dlm = val;
+			break;
+		}
+		if ((val & 2) && !(uart.ier & 2))
+			uart.thre = 1; // Enabling ETBEI with THR empty interrupts at once
+		uart.ier = val & 0x0f;
+		break;
+	case 2:
+		uart.fcr = val & 0xc1;
+		if (val & 2)
+			uart.rx_count = 0; // Clear RX FIFO
+		uart_poll();
+		break;
+	case 3: uart.lcr = val; break;
+	case 4: uart.mcr = val & 0x1f; break;
+	case 7: uart.scr = val; break;
+	}
+}
+
+// Hand the transmit ring to the terminal, at most two putstr calls
+void uart_tx_flush(void) {
+	while (uart_tx_head != uart_tx_tail) {
+		VMUINT32 tail = uart_tx_tail & (UART_TX_SIZE - 1);
+		VMUINT32 len = uart_tx_head - uart_tx_tail;
+		if (len > UART_TX_SIZE - tail)
+			len = UART_TX_SIZE - tail; // Up to the wrap point
+		console_str_with_length_in(uart_tx + tail, len);
+		uart_tx_tail += len;
+	}
+}
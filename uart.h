@@ -0,0 +1,44 @@
+#pragma once
+#include "vmsys.h"
+
+/*
+ * 16550A UART on the terminal.
+ * RX is a 16-byte FIFO topped up from serial_in (the keyboard ring), TX
+ * bytes go to a ring drained to the terminal by uart_tx_flush(). The
+ * transmitter is never busy, so THRE and TEMT always read as set. The
+ * interrupt line goes to PLIC source UART_IRQ.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UART_BASE 0x10000000
+#define UART_SIZE 8                           // reg-shift 0, byte registers
+#define UART_IRQ 1                            // PLIC source
+#define UART_FIFO_SIZE 16
+
+#ifndef UART_TX_SIZE
+#define UART_TX_SIZE 4096                     // Transmit ring (bytes, power of two), see uart_tx_flush()
+#endif
+
+typedef struct {
+	VMUINT8 ier, lcr, mcr, scr, fcr;
+	VMUINT8 dll, dlm;
+	VMUINT8 thre;                             // THR empty interrupt pending
+	VMUINT8 rx_head, rx_count;                // RX FIFO, rx_head is the oldest byte
+	char rx_buf[UART_FIFO_SIZE];
+} uart_t;                                     // No pointers, saved as is in state.bin
+
+extern uart_t uart;
+
+void uart_reset(void);
+void uart_poll(void);
+int uart_irq(void);
+VMUINT32 uart_load(VMUINT32 reg);
+void uart_store(VMUINT32 reg, VMUINT32 val);
+void uart_tx_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,312 @@
+/*
+ * virtio-mmio block device for mrv32, see vblk.h.
+ */
+
+#include "vblk.h"
+#include "virtio.h"
+#include "vram.h"
+#include "string.h"
+
+#define VBLK_MAX_SECTORS (0x7fffffff / VBLK_SECTOR) // File offsets are signed 32 bit
+
+// Feature bits, word 0
+#define VBLK_F_SEG_MAX (1u << 2)
+#define VBLK_F_RO (1u << 5)
+#define VBLK_F_FLUSH (1u << 9)
+
+// Requests
+#define VBLK_T_IN 0
+#define VBLK_T_OUT 1
+#define VBLK_T_FLUSH 4
+#define VBLK_T_GET_ID 8
+#define VBLK_OK 0
+#define VBLK_IOERR 1
+#define VBLK_UNSUPP 2
+#define VBLK_ID "mrv32 disk"                  // Up to 20 bytes
+
+typedef struct {
+	VMUINT32 ofs;                             // Guest RAM offset
+	VMUINT32 len;
+} vblk_seg_t;
+
+vblk_t vblk;
+
+static VMUINT32 vblk_ram_size;
+static vblk_dma_t vblk_written;
+static VMFILE vblk_file = -1;
+static int vblk_ro;
+static VMUINT32 vblk_sectors;
+
+void vblk_init(VMUINT32 ram_size, vblk_dma_t written) {
+	vblk_ram_size = ram_size;
+	vblk_written = written;
+	vblk_reset();
+}
+
+// Takes over the image file handle
+void vblk_open(VMFILE image, int read_only) {
+	VMUINT size = 0;
+
+	vblk_file = image;
+	vblk_ro = read_only;
+	vm_file_getfilesize(image, &size);
+	vblk_sectors = size / VBLK_SECTOR;
+	if (vblk_sectors > VBLK_MAX_SECTORS)
+		vblk_sectors = VBLK_MAX_SECTORS;
+}
+
+// Make what the guest wrote durable
+void vblk_flush(void) {
+	if (vblk_file >= 0 && !vblk_ro)
+		vm_file_commit(vblk_file);
+}
+
+void vblk_close(void) {
+	if (vblk_file < 0)
+		return;
+	vblk_flush();
+	vm_file_close(vblk_file);
+	vblk_file = -1;
+}
+
+void vblk_reset(void) {
+	memset(&vblk, 0, sizeof(vblk));
+}
+
+int vblk_irq(void) {
+	return vblk.isr != 0;
+}
+
+// Guest RAM offset of a guest physical range, 0xFFFFFFFF if it isn't all in RAM
+static VMUINT32 vblk_ram(VMUINT32 addr, VMUINT32 len) {
+	VMUINT32 ofs = addr - VIRTIO_RAM_OFFSET;
+
+	if (ofs >= vblk_ram_size || vblk_ram_size - ofs < len)
+		return 0xFFFFFFFF;
+	return ofs;
+}
+
+// Move len bytes between the image at its current position and guest RAM at ofs.
+// The file reads and writes the page cache in place, one call per page or resident region.
+static int vblk_xfer(VMUINT32 ofs, VMUINT32 len, int to_ram) {
+	VMUINT32 n, p;
+	VMUINT done;
+
+	while (len) {
+		n = vram_span(ofs);
+		if (n > len)
+			n = len;
+		done = 0;
+		if (to_ram) {
+			vm_file_read_opt(vblk_file, vram_ptr_w(ofs), n, &done);
+			for (p = (ofs & ~VRAM_PAGE_MASK) + VRAM_PAGE_SIZE; p < ofs + n; p += VRAM_PAGE_SIZE)
+				vram_ptr_w(p); // Rest of a resident region, mark those pages dirty too
+			if (vblk_written)
+				vblk_written(ofs, n);
+		} else {
+			vm_file_write_opt(vblk_file, vram_ptr(ofs), n, &done);
+		}
+		if (done != n)
+			return 0;
+		ofs += n;
+		len -= n;
+	}
+	return 1;
+}
+
+// Same over a list of buffers, skipping the first skip bytes of them
+static int vblk_xfer_segs(const vblk_seg_t *s, int count, VMUINT32 skip, VMUINT32 len, int to_ram) {
+	VMUINT32 n;
+
+	for (; count && len; s++, count--) {
+		if (skip >= s->len) {
+			skip -= s->len;
+			continue;
+		}
+		n = s->len - skip < len ? s->len - skip : len;
+		if (!vblk_xfer(s->ofs + skip, n, to_ram))
+			return 0;
+		skip = 0;
+		len -= n;
+	}
+	return 1;
+}
+
+// Small copies between the buffers and host memory: request header, status, ID
+static void vblk_copy_segs(const vblk_seg_t *s, int count, VMUINT32 skip, VMUINT8 *data, VMUINT32 len, int to_ram) {
+	VMUINT32 i;
+
+	for (; count && len; s++, count--) {
+		for (i = skip; i < s->len && len; i++, len--) {
+			if (to_ram) {
+				vram_store1(s->ofs + i, *data++);
+				if (vblk_written)
+					vblk_written(s->ofs + i, 1);
+			} else {
+				*data++ = vram_load1(s->ofs + i);
+			}
+		}
+		skip = skip > s->len ? skip - s->len : 0;
+	}
+}
+
+// Carry out the request whose descriptor chain starts at head.
+// Returns the number of bytes written into the guest's buffers.
+static VMUINT32 vblk_request(VMUINT32 head) {
+	vblk_seg_t rd[VBLK_QUEUE_MAX], wr[VBLK_QUEUE_MAX];
+	int nr = 0, nw = 0, i;
+	VMUINT32 d = head, da, ofs, len, flags, rlen = 0, wlen = 0, data, written = 0;
+	VMUINT32 hdr[4];
+	VMUINT8 status = VBLK_OK;
+
+	// Device readable buffers come first, then the writable ones.
+	// Anything broken gets nothing written back, not even the status.
+	for (i = 0; ; i++) {
+		if (i == (int)vblk.queue_num || d >= vblk.queue_num)
+			return 0; // Looped, or off the table
+		da = vblk_ram(vblk.desc + 16 * d, 16);
+		if (da == 0xFFFFFFFF)
+			return 0;
+		len = vram_load4(da + 8);
+		flags = vram_load2(da + 12);
+		ofs = vblk_ram(vram_load4(da), len);
+		if (ofs == 0xFFFFFFFF || vram_load4(da + 4))
+			return 0;
+		if (flags & VIRTIO_D_WRITE) {
+			wr[nw].ofs = ofs;
+			wr[nw++].len = len;
+			wlen += len;
+		} else {
+			if (nw)
+				return 0;
+			rd[nr].ofs = ofs;
+			rd[nr++].len = len;
+			rlen += len;
+		}
+		if (!(flags & VIRTIO_D_NEXT))
+			break;
+		d = vram_load2(da + 14);
+	}
+	if (rlen < sizeof(hdr) || wlen < 1)
+		return 0;
+
+	vblk_copy_segs(rd, nr, 0, (VMUINT8*)hdr, sizeof(hdr), 0);
+	switch (hdr[0]) {
+	case VBLK_T_IN:
+	case VBLK_T_OUT:
+		data = hdr[0] == VBLK_T_IN ? wlen - 1 : rlen - sizeof(hdr);
+		if (vblk_file < 0 || hdr[3] || hdr[2] > vblk_sectors || (data + VBLK_SECTOR - 1) / VBLK_SECTOR > vblk_sectors - hdr[2] ||
+			(hdr[0] == VBLK_T_OUT && vblk_ro)) {
+			status = VBLK_IOERR;
+			break;
+		}
+		vm_file_seek_opt(vblk_file, hdr[2] * VBLK_SECTOR, BASE_BEGIN);
+		if (hdr[0] == VBLK_T_IN) {
+			if (!vblk_xfer_segs(wr, nw, 0, data, 1))
+				status = VBLK_IOERR;
+			written = data;
+		} else if (!vblk_xfer_segs(rd, nr, sizeof(hdr), data, 0)) {
+			status = VBLK_IOERR;
+		}
+		break;
+	case VBLK_T_FLUSH:
+		vblk_flush();
+		break;
+	case VBLK_T_GET_ID:
+		written = wlen - 1 < sizeof(VBLK_ID) ? wlen - 1 : sizeof(VBLK_ID);
+		vblk_copy_segs(wr, nw, 0, (VMUINT8*)VBLK_ID, written, 1);
+		break;
+	default:
+		status = VBLK_UNSUPP;
+		break;
+	}
+
+	vblk_copy_segs(wr, nw, wlen - 1, &status, 1, 1);
+	return written + 1;
+}
+
+// QueueNotify: service everything the driver made available, in order
+static void vblk_notify(void) {
+	VMUINT32 num = vblk.queue_num, avail, used, head, len, slot;
+
+	if (!vblk.queue_ready || !(vblk.status & VIRTIO_S_DRIVER_OK) || num == 0)
+		return;
+	avail = vblk_ram(vblk.avail, 4 + 2 * num);
+	used = vblk_ram(vblk.used, 4 + 8 * num);
+	if (avail == 0xFFFFFFFF || used == 0xFFFFFFFF)
+		return;
+
+	// Every request completes right away, so the used index follows last_avail
+	while ((VMUINT16)vblk.last_avail != vram_load2(avail + 2)) {
+		head = vram_load2(avail + 4 + 2 * (vblk.last_avail % num));
+		len = vblk_request(head);
+		slot = used + 4 + 8 * (vblk.last_avail % num);
+		vram_store4(slot, head);
+		vram_store4(slot + 4, len);
+		vblk.last_avail++;
+		vram_store2(used + 2, (VMUINT16)vblk.last_avail);
+	}
+	if (!(vram_load2(avail) & VIRTIO_AVAIL_F_NO_INTERRUPT))
+		vblk.isr |= 1;
+}
+
+VMUINT32 vblk_load(VMUINT32 reg) {
+	if (reg >= 0x100 && (reg & 3)) // Config space may be read a byte at a time
+		return vblk_load(reg & ~3) >> ((reg & 3) * 8);
+	switch (reg) {
+	case 0x000: return VIRTIO_MAGIC;
+	case 0x004: return 2;
+	case 0x008: return vblk_file >= 0 ? 2 : 0;
+	case 0x00c: return VIRTIO_VENDOR;
+	case 0x010:
+		if (vblk.dev_features_sel == 0)
+			return VBLK_F_SEG_MAX | VBLK_F_FLUSH | (vblk_ro ? VBLK_F_RO : 0);
+		return vblk.dev_features_sel == 1 ? VIRTIO_F_VERSION_1 : 0;
+	case 0x034: return vblk.queue_sel == 0 ? VBLK_QUEUE_MAX : 0;
+	case 0x044: return vblk.queue_sel == 0 ? vblk.queue_ready : 0;
+	case 0x060: return vblk.isr;
+	case 0x070: return vblk.status;
+	case 0x0fc: return 0;
+	case 0x100: return vblk_sectors;
+	case 0x104: return 0;
+	case 0x10c: return VBLK_QUEUE_MAX - 2; // Header and status take a descriptor each
+	}
+	return 0;
+}
+
+void vblk_store(VMUINT32 reg, VMUINT32 val) {
+	switch (reg) {
+	case 0x014: vblk.dev_features_sel = val; break;
+	case 0x020:
+		if (vblk.drv_features_sel < 2)
+			vblk.drv_features[vblk.drv_features_sel] = val;
+		break;
+	case 0x024: vblk.drv_features_sel = val; break;
+	case 0x030: vblk.queue_sel = val; break;
+	case 0x038:
+		if (vblk.queue_sel == 0 && val <= VBLK_QUEUE_MAX)
+			vblk.queue_num = val;
+		break;
+	case 0x044:
+		if (vblk.queue_sel == 0)
+			vblk.queue_ready = val & 1;
+		break;
+	case 0x050:
+		if (val == 0)
+			vblk_notify();
+		break;
+	case 0x064: vblk.isr &= ~val; break;
+	case 0x070:
+		if (val == 0) {
+			vblk_reset();
+			break;
+		}
+		vblk.status = val;
+		if ((val & VIRTIO_S_FEATURES_OK) && !(vblk.drv_features[1] & VIRTIO_F_VERSION_1))
+			vblk.status &= ~VIRTIO_S_FEATURES_OK; // Legacy drivers aren't supported
+		break;
+	case 0x080: if (vblk.queue_sel == 0) vblk.desc = val; break;
+	case 0x090: if (vblk.queue_sel == 0) vblk.avail = val; break;
+	case 0x0a0: if (vblk.queue_sel == 0) vblk.used = val; break;
+	}
+}
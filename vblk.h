@@ -0,0 +1,68 @@
+#pragma once
+#include "vmsys.h"
+#include "vmio.h"
+
+/*
+ * Block device, virtio-mmio version 2 with one split virtqueue. The stock
+ * virtio_blk driver works with it, given "virtio,mmio" in the device tree.
+ * The disk is an image file on the memory card, opened by main.c. Without one
+ * DeviceID reads 0 and the guest driver leaves the slot alone.
+ *
+ * Requests are serviced as soon as the guest writes QueueNotify: every
+ * buffer the driver made available is moved between the image and guest
+ * RAM with one file call per cached page, or per resident region, then
+ * returned on the used ring and VBLK_IRQ raised.
+ *
+ * Registers relative to VBLK_BASE, see the virtio spec for the details:
+ *   0x000 MagicValue "virt"         0x050 QueueNotify
+ *   0x004 Version 2                 0x060 InterruptStatus
+ *   0x008 DeviceID 2 (block)        0x064 InterruptACK
+ *   0x010 DeviceFeatures            0x070 Status
+ *   0x014 DeviceFeaturesSel         0x080 QueueDesc
+ *   0x020 DriverFeatures            0x090 QueueDriver (avail ring)
+ *   0x024 DriverFeaturesSel         0x0a0 QueueDevice (used ring)
+ *   0x030 QueueSel                  0x0fc ConfigGeneration
+ *   0x034 QueueNumMax               0x100 capacity in sectors (64 bit)
+ *   0x038 QueueNum                  0x10c seg_max
+ *   0x044 QueueReady
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VBLK_BASE 0x10002000
+#define VBLK_SIZE 0x200
+#define VBLK_IRQ 3                            // PLIC source
+#define VBLK_QUEUE_MAX 16                     // Descriptors in the queue, also the longest chain
+#define VBLK_SECTOR 512
+
+typedef struct {
+	VMUINT32 status;                          // Device status, written by the driver
+	VMUINT32 dev_features_sel;
+	VMUINT32 drv_features_sel;
+	VMUINT32 drv_features[2];
+	VMUINT32 queue_sel;
+	VMUINT32 queue_num;
+	VMUINT32 queue_ready;
+	VMUINT32 desc, avail, used;               // Guest physical addresses of the queue parts
+	VMUINT32 last_avail;                      // Avail ring index serviced up to, free running
+	VMUINT32 isr;                             // InterruptStatus
+} vblk_t;                                     // Saved as is in state.bin
+
+typedef void (*vblk_dma_t)(VMUINT32 ofs, VMUINT32 len); // Guest RAM written behind the core's back
+
+extern vblk_t vblk;
+
+void vblk_init(VMUINT32 ram_size, vblk_dma_t written);
+void vblk_open(VMFILE image, int read_only);
+void vblk_flush(void);
+void vblk_close(void);
+void vblk_reset(void);
+int vblk_irq(void);
+VMUINT32 vblk_load(VMUINT32 reg);
+void vblk_store(VMUINT32 reg, VMUINT32 val);
+
+#ifdef __cplusplus
+}
+#endif
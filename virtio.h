@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+ * What the virtio-mmio devices share, see vblk.h for the register layout.
+ * Version 2 (modern) transport only, split virtqueues.
+ */
+
+#define VIRTIO_RAM_OFFSET 0x80000000          // MINIRV32_RAM_IMAGE_OFFSET
+#define VIRTIO_MAGIC 0x74726976               // "virt"
+#define VIRTIO_VENDOR 0x3376726d              // "mrv3"
+
+// Feature bits, word 1
+#define VIRTIO_F_VERSION_1 (1u << 0)
+
+// Device status bits
+#define VIRTIO_S_DRIVER_OK 4
+#define VIRTIO_S_FEATURES_OK 8
+
+// Descriptor flags
+#define VIRTIO_D_NEXT 1
+#define VIRTIO_D_WRITE 2
+
+// Avail ring flags
+#define VIRTIO_AVAIL_F_NO_INTERRUPT 1
@@ -0,0 +1,789 @@
+/*
+ * Virtual RAM backing store for mrv32.
+ * Write-back page cache with CLOCK eviction in front of the RAM file,
+ * plus optional resident regions at both ends of guest RAM.
+ */
+
+#include "vram.h"
+#include "perf.h"
+#include "string.h"
+
+VMINT16 *vram_map = NULL;
+vram_slot_t *vram_slots = NULL;
+int vram_slot_count = 0;
+
+VMUINT8 *vram_image = NULL;
+VMUINT8 *vram_image_hi = NULL;
+VMUINT32 vram_res_lo = 0;
+VMUINT32 vram_res_hi = 0xFFFFFFFF;
+VMUINT8 *vram_res_dirty = NULL;
+
+VMUINT32 vram_pages = 0;
+VMUINT32 *vram_snap_dirty = NULL;
+
+VMUINT32 vram_lazy_count = 0;
+static VMUINT32 *vram_lazy = NULL;            // Per guest page bit, set while the page is only in vram_lazy_file
+static VMFILE vram_lazy_file = -1;
+static VMUINT32 vram_lazy_ofs;                // Offset of guest RAM in vram_lazy_file
+static VMUINT32 vram_lazy_next;               // Where vram_lazy_fill() goes on
+static VMUINT8 *vram_lazy_buf = NULL;         // One page for vram_lazy_fill()
+
+static VMFILE vram_base = -1;                 // Read-only base image in overlay mode
+static VMUINT32 vram_base_size;
+static VMUINT16 *vram_base_index = NULL;      // Boot image page index: guest page -> slot + 1 in the base, 0 if all zero. NULL for a raw base.
+static VMUINT32 vram_base_data;               // Offset of its slot 0
+static VMUINT16 *vram_cow = NULL;             // Overlay page index: guest page -> slot + 1 in the RAM file, 0 if never written
+static VMUINT32 vram_cow_slots;               // Slots in use
+static VMUINT32 vram_cow_data;                // Offset of slot 0
+
+static VMUINT32 *vram_zero = NULL;           // Per guest page bit, set while the page is known to be all zero in the backing store
+
+static VMFILE vram_file;
+static VMUINT32 vram_file_size;              // Bytes in the RAM file, outside overlay mode
+static VMUINT8 *vram_res_block = NULL;
+static VMUINT8 *vram_pool = NULL;
+static int vram_hand = 0;                     // CLOCK hand
+
+static VMUINT8 *vram_io = NULL;               // Staging buffer for readahead and coalesced write-back
+static VMUINT32 vram_io_pages = 0;
+static VMUINT32 vram_ra_next = 0xFFFFFFFF;    // Page a sequential stream of misses would fault next
+static VMUINT32 vram_ra_window = 0;           // Pages read at once for that stream, 0 if there is none
+
+static int vram_is_lazy(VMUINT32 page) {
+	return vram_lazy_count && (vram_lazy[page >> 5] & (1u << (page & 31)));
+}
+
+static int vram_is_zero(VMUINT32 page) {
+	return (vram_zero[page >> 5] >> (page & 31)) & 1;
+}
+
+static void vram_set_zero(VMUINT32 page, int zero) {
+	if (zero)
+		vram_zero[page >> 5] |= 1u << (page & 31);
+	else
+		vram_zero[page >> 5] &= ~(1u << (page & 31));
+}
+
+static int vram_page_zero(const VMUINT8 *data) {
+	const VMUINT32 *p = (const VMUINT32*)data, *end = p + VRAM_PAGE_SIZE / 4;
+	while (p < end)
+		if (*p++)
+			return 0;
+	return 1;
+}
+
+// Pages the backing store holds nothing for read as zero, see vram_store_read()
+static void vram_zero_init(void) {
+	VMUINT32 p;
+	for (p = 0; p < vram_pages; p++)
+		if (vram_cow == NULL)
+			vram_set_zero(p, p << VRAM_PAGE_SHIFT >= vram_file_size);
+		else if (vram_base_index == NULL)
+			vram_set_zero(p, !vram_cow[p] && p << VRAM_PAGE_SHIFT >= vram_base_size);
+		else
+			vram_set_zero(p, !vram_cow[p] && !vram_base_index[p]);
+}
+
+static void vram_file_read(VMFILE f, VMUINT32 ofs, VMUINT8 *data, VMUINT32 len) {
+	VMUINT r = 0;
+	vm_file_seek_opt(f, ofs, BASE_BEGIN);
+	vm_file_read_opt(f, data, len, &r);
+	PERF_INC(perf.file_reads);
+	PERF_ADD(perf.bytes_read, r);
+	if (r < len) // Past the end of a short file, treat as zero
+		memset(data + r, 0, len - r);
+}
+
+// Never written pages in overlay mode. A boot image holds its pages in page
+// order, so a run of them is one read, and zero pages are no read at all.
+static void vram_base_read(VMUINT32 ofs, VMUINT8 *data, VMUINT32 len) {
+	VMUINT32 n, slot, first;
+
+	if (vram_base_index == NULL) {
+		if (ofs >= vram_base_size)
+			memset(data, 0, len); // Past the end of the base, zero without any I/O
+		else
+			vram_file_read(vram_base, ofs, data, len);
+		return;
+	}
+	while (len) {
+		n = VRAM_PAGE_SIZE - (ofs & VRAM_PAGE_MASK);
+		if (n > len)
+			n = len;
+		first = ofs >> VRAM_PAGE_SHIFT;
+		slot = vram_base_index[first];
+		while (n < len && vram_base_index[(ofs + n) >> VRAM_PAGE_SHIFT] == (slot ? slot + ((ofs + n) >> VRAM_PAGE_SHIFT) - first : 0))
+			n = n + VRAM_PAGE_SIZE < len ? n + VRAM_PAGE_SIZE : len;
+		if (slot)
+			vram_file_read(vram_base, vram_base_data + ((slot - 1) << VRAM_PAGE_SHIFT) + (ofs & VRAM_PAGE_MASK), data, n);
+		else
+			memset(data, 0, n);
+		data += n;
+		ofs += n;
+		len -= n;
+	}
+}
+
+// Read guest RAM from the backing store: the RAM file, or in overlay mode
+// written pages from their slots and the rest from the base
+void vram_store_read(VMUINT32 ofs, VMUINT8 *data, VMUINT32 len) {
+	VMUINT32 n, slot;
+
+	if (vram_cow == NULL) {
+		vram_file_read(vram_file, ofs, data, len);
+		return;
+	}
+	while (len) {
+		n = VRAM_PAGE_SIZE - (ofs & VRAM_PAGE_MASK);
+		if (n > len)
+			n = len;
+		slot = vram_cow[ofs >> VRAM_PAGE_SHIFT];
+		if (slot) {
+			vram_file_read(vram_file, vram_cow_data + ((slot - 1) << VRAM_PAGE_SHIFT) + (ofs & VRAM_PAGE_MASK), data, n);
+		} else {
+			// Run of pages never written, one read from the base
+			while (n < len && !vram_cow[(ofs + n) >> VRAM_PAGE_SHIFT])
+				n = n + VRAM_PAGE_SIZE < len ? n + VRAM_PAGE_SIZE : len;
+			vram_base_read(ofs, data, n);
+		}
+		data += n;
+		ofs += n;
+		len -= n;
+	}
+}
+
+// Fill a short RAM file with zeros up to ofs, writes past the end are not allowed on every card driver
+static int vram_file_extend(VMUINT32 ofs) {
+	VMUINT32 small[16];
+	VMUINT8 *zero = (VMUINT8*)vm_calloc(VRAM_PAGE_SIZE);
+	VMUINT chunk = VRAM_PAGE_SIZE, n, w;
+	int ok = 1;
+
+	if (zero == NULL) { // Slower, but don't lose the write
+		memset(small, 0, sizeof(small));
+		zero = (VMUINT8*)small;
+		chunk = sizeof(small);
+	}
+	vm_file_seek_opt(vram_file, vram_file_size, BASE_BEGIN);
+	while (ok && vram_file_size < ofs) {
+		n = ofs - vram_file_size < chunk ? ofs - vram_file_size : chunk;
+		w = 0;
+		vm_file_write_opt(vram_file, zero, n, &w);
+		PERF_INC(perf.file_writes);
+		PERF_ADD(perf.bytes_written, w);
+		ok = w == n;
+		vram_file_size += w;
+	}
+	if (zero != (VMUINT8*)small)
+		vm_free(zero);
+	return ok;
+}
+
+// Write guest RAM to the backing store, whole pages in overlay mode.
+// Only whole pages are tracked in vram_zero, callers write page aligned runs.
+// A page written for the first time gets the next slot, and its index entry goes to the file right away.
+int vram_store_write(VMUINT32 ofs, const VMUINT8 *data, VMUINT32 len) {
+	VMUINT32 page;
+	VMUINT16 slot;
+	VMUINT w = 0;
+
+	for (page = ofs >> VRAM_PAGE_SHIFT; page < (ofs + len) >> VRAM_PAGE_SHIFT; page++)
+		vram_set_zero(page, vram_page_zero(data + ((page << VRAM_PAGE_SHIFT) - ofs)));
+
+	if (vram_cow == NULL) {
+		if (ofs > vram_file_size && !vram_file_extend(ofs))
+			return 0;
+		vm_file_seek_opt(vram_file, ofs, BASE_BEGIN);
+		vm_file_write_opt(vram_file, (void*)data, len, &w);
+		PERF_INC(perf.file_writes);
+		PERF_ADD(perf.bytes_written, w);
+		if (ofs + w > vram_file_size)
+			vram_file_size = ofs + w;
+		return w == len;
+	}
+	for (; len >= VRAM_PAGE_SIZE; ofs += VRAM_PAGE_SIZE, data += VRAM_PAGE_SIZE, len -= VRAM_PAGE_SIZE) {
+		page = ofs >> VRAM_PAGE_SHIFT;
+		if (!vram_cow[page]) {
+			slot = (VMUINT16)++vram_cow_slots;
+			vm_file_seek_opt(vram_file, VRAM_COW_INDEX + page * sizeof(VMUINT16), BASE_BEGIN);
+			vm_file_write_opt(vram_file, &slot, sizeof(slot), &w);
+			PERF_INC(perf.file_writes);
+			PERF_ADD(perf.bytes_written, w);
+			if (w != sizeof(slot))
+				return 0;
+			vram_cow[page] = slot;
+		}
+		w = 0;
+		vm_file_seek_opt(vram_file, vram_cow_data + ((vram_cow[page] - 1) << VRAM_PAGE_SHIFT), BASE_BEGIN);
+		vm_file_write_opt(vram_file, (void*)data, VRAM_PAGE_SIZE, &w);
+		PERF_INC(perf.file_writes);
+		PERF_ADD(perf.bytes_written, w);
+		if (w != VRAM_PAGE_SIZE)
+			return 0;
+	}
+	return 1;
+}
+
+#define VRAM_SRC_STORE 0
+#define VRAM_SRC_LAZY 1
+#define VRAM_SRC_ZERO 2
+
+static int vram_source(VMUINT32 page) {
+	if (vram_is_lazy(page))
+		return VRAM_SRC_LAZY;
+	return vram_is_zero(page) ? VRAM_SRC_ZERO : VRAM_SRC_STORE;
+}
+
+// Read len bytes of guest RAM from ofs (page aligned), each page from wherever it currently lives.
+// Known zero pages cost no I/O, and pages read from the store are checked so they do next time.
+static void vram_read_range(VMUINT8 *data, VMUINT32 ofs, VMUINT32 len) {
+	VMUINT n, i;
+	int src;
+
+	while (len) {
+		src = vram_source(ofs >> VRAM_PAGE_SHIFT);
+		for (n = VRAM_PAGE_SIZE; n < len && vram_source((ofs + n) >> VRAM_PAGE_SHIFT) == src; n += VRAM_PAGE_SIZE)
+			;
+		if (n > len)
+			n = len;
+
+		if (src == VRAM_SRC_LAZY) {
+			vram_file_read(vram_lazy_file, vram_lazy_ofs + ofs, data, n);
+		} else if (src == VRAM_SRC_ZERO) {
+			memset(data, 0, n);
+		} else {
+			vram_store_read(ofs, data, n);
+			for (i = 0; i + VRAM_PAGE_SIZE <= n; i += VRAM_PAGE_SIZE)
+				if (vram_page_zero(data + i))
+					vram_set_zero((ofs + i) >> VRAM_PAGE_SHIFT, 1);
+		}
+		data += n;
+		ofs += n;
+		len -= n;
+	}
+}
+
+static void vram_read_page(VMUINT8 *data, VMUINT32 page) {
+	vram_read_range(data, page << VRAM_PAGE_SHIFT, VRAM_PAGE_SIZE);
+}
+
+// Nothing to write if the store already holds zeros and the page is still all zero.
+// Not for a page still read from a checkpoint: the checkpoint may hold something else,
+// so the write has to happen and reach vram_snap_dirty, or the next delta snapshot misses it.
+static int vram_write_elided(VMUINT32 page, const VMUINT8 *data) {
+	return !vram_is_lazy(page) && vram_is_zero(page) && vram_page_zero(data);
+}
+
+static void vram_write_page(vram_slot_t *s) {
+	int elided = vram_write_elided(s->page, s->data); // Before the page stops being lazy
+
+	vram_lazy_drop(s->page);
+	s->dirty = 0;
+	if (elided)
+		return;
+	vram_snap_dirty[s->page >> 5] |= 1u << (s->page & 31);
+	vram_store_write(s->page << VRAM_PAGE_SHIFT, s->data, VRAM_PAGE_SIZE);
+}
+
+int vram_init(VMFILE file, VMUINT32 size, int page_count) {
+	VMUINT32 i;
+
+	vram_file = file;
+	vram_pages = (size + VRAM_PAGE_MASK) >> VRAM_PAGE_SHIFT;
+
+	vram_map = (VMINT16*)vm_malloc(vram_pages * sizeof(VMINT16));
+	if (vram_map == NULL)
+		return 0;
+	for (i = 0; i < vram_pages; i++)
+		vram_map[i] = VRAM_NO_SLOT;
+
+	vram_snap_dirty = (VMUINT32*)vm_calloc((vram_pages + 31) / 32 * sizeof(VMUINT32));
+	vram_zero = (VMUINT32*)vm_calloc((vram_pages + 31) / 32 * sizeof(VMUINT32));
+	if (vram_snap_dirty == NULL || vram_zero == NULL) {
+		vram_deinit();
+		return 0;
+	}
+	vram_file_size = 0;
+	vm_file_getfilesize(file, &vram_file_size);
+	vram_zero_init();
+
+	// Take as many pages as the heap allows, up to page_count
+	if (page_count > 0x7fff)
+		page_count = 0x7fff;
+	while (page_count >= VRAM_MIN_PAGE_COUNT) {
+		vram_pool = (VMUINT8*)vm_malloc(page_count * VRAM_PAGE_SIZE);
+		if (vram_pool != NULL)
+			break;
+		page_count /= 2;
+	}
+	if (vram_pool == NULL) {
+		vram_deinit();
+		return 0;
+	}
+
+	vram_slots = (vram_slot_t*)vm_calloc(page_count * sizeof(vram_slot_t));
+	if (vram_slots == NULL) {
+		vram_deinit();
+		return 0;
+	}
+	for (i = 0; i < (VMUINT32)page_count; i++)
+		vram_slots[i].data = vram_pool + i * VRAM_PAGE_SIZE;
+
+	// Without the staging buffer every miss and write-back is a page at a time
+	for (vram_io_pages = VRAM_IO_PAGES; vram_io_pages >= 2; vram_io_pages /= 2) {
+		vram_io = (VMUINT8*)vm_malloc(vram_io_pages * VRAM_PAGE_SIZE);
+		if (vram_io != NULL)
+			break;
+	}
+	if (vram_io == NULL)
+		vram_io_pages = 0;
+	if (vram_io_pages > (VMUINT32)page_count / 8)
+		vram_io_pages = page_count / 8; // Readahead mustn't flush the whole cache
+
+	vram_slot_count = page_count;
+	vram_hand = 0;
+	vram_ra_next = 0xFFFFFFFF;
+	vram_ra_window = 0;
+	return page_count;
+}
+
+// Write back runs of dirty resident pages in [first, last), one write per run
+static void vram_flush_resident(VMUINT32 first, VMUINT32 last) {
+	VMUINT32 p = first, run;
+
+	while (p < last) {
+		if (vram_res_dirty[p] && vram_write_elided(p, vram_ptr(p << VRAM_PAGE_SHIFT))) {
+			vram_res_dirty[p] = 0;
+			vram_lazy_drop(p);
+		}
+		if (!vram_res_dirty[p]) {
+			p++;
+			continue;
+		}
+		for (run = p; run < last && vram_res_dirty[run] && !vram_write_elided(run, vram_ptr(run << VRAM_PAGE_SHIFT)); run++) {
+			vram_res_dirty[run] = 0;
+			vram_snap_dirty[run >> 5] |= 1u << (run & 31);
+			vram_lazy_drop(run);
+		}
+		vram_store_write(p << VRAM_PAGE_SHIFT, vram_ptr(p << VRAM_PAGE_SHIFT), (run - p) << VRAM_PAGE_SHIFT);
+		p = run;
+	}
+}
+
+// Keep up to max bytes of guest RAM resident, high of them at the top of RAM, the rest from offset 0.
+// The block is sized from what the heap can give while keeping VRAM_HEAP_RESERVE free.
+// Call after vram_init(). Returns the number of resident bytes.
+VMUINT32 vram_init_resident(VMUINT32 max, VMUINT32 high) {
+	VMUINT32 total, lo_len, hi_len;
+	void *reserve;
+
+	vram_res_dirty = (VMUINT8*)vm_calloc(vram_pages);
+	if (vram_res_dirty == NULL)
+		return 0;
+
+	// Hold the reserve while probing so the block doesn't eat all of the heap
+	reserve = vm_malloc(VRAM_HEAP_RESERVE);
+	if (reserve == NULL)
+		return 0;
+
+	total = max < vram_pages << VRAM_PAGE_SHIFT ? max & ~VRAM_PAGE_MASK : vram_pages << VRAM_PAGE_SHIFT;
+	while (total >= VRAM_MIN_RESIDENT) {
+		vram_res_block = (VMUINT8*)vm_malloc(total);
+		if (vram_res_block != NULL)
+			break;
+		total = (total / 2) & ~VRAM_PAGE_MASK;
+	}
+	vm_free(reserve);
+	if (vram_res_block == NULL)
+		return 0;
+
+	hi_len = (high + VRAM_PAGE_MASK) & ~VRAM_PAGE_MASK;
+	if (hi_len > total / 2)
+		hi_len = (total / 2) & ~VRAM_PAGE_MASK;
+	if (total == vram_pages << VRAM_PAGE_SHIFT)
+		hi_len = 0; // Everything fits in the low part
+	lo_len = total - hi_len;
+
+	vram_image = vram_res_block;
+	vram_res_lo = lo_len;
+	vram_read_range(vram_image, 0, lo_len);
+
+	if (hi_len) {
+		vram_image_hi = vram_res_block + lo_len;
+		vram_res_hi = (vram_pages << VRAM_PAGE_SHIFT) - hi_len;
+		vram_read_range(vram_image_hi, vram_res_hi, hi_len);
+	}
+
+	return total;
+}
+
+void vram_deinit(void) {
+	vram_lazy_end();
+	if (vram_cow)
+		vm_free(vram_cow);
+	if (vram_base_index)
+		vm_free(vram_base_index);
+	if (vram_base >= 0)
+		vm_file_close(vram_base);
+	vram_cow = NULL;
+	vram_base_index = NULL;
+	vram_base = -1;
+	if (vram_slots)
+		vm_free(vram_slots);
+	if (vram_pool)
+		vm_free(vram_pool);
+	if (vram_io)
+		vm_free(vram_io);
+	vram_io = NULL;
+	vram_io_pages = 0;
+	if (vram_map)
+		vm_free(vram_map);
+	if (vram_res_block)
+		vm_free(vram_res_block);
+	if (vram_res_dirty)
+		vm_free(vram_res_dirty);
+	if (vram_snap_dirty)
+		vm_free(vram_snap_dirty);
+	if (vram_zero)
+		vm_free(vram_zero);
+	vram_zero = NULL;
+	vram_slots = NULL;
+	vram_pool = NULL;
+	vram_map = NULL;
+	vram_slot_count = 0;
+	vram_res_block = NULL;
+	vram_res_dirty = NULL;
+	vram_snap_dirty = NULL;
+	vram_image = vram_image_hi = NULL;
+	vram_res_lo = 0;
+	vram_res_hi = 0xFFFFFFFF;
+}
+
+// Cache slot holding page if it is cached and dirty, else NULL
+static vram_slot_t *vram_dirty_slot(VMUINT32 page) {
+	VMINT16 i = vram_map[page];
+	return i != VRAM_NO_SLOT && vram_slots[i].dirty ? &vram_slots[i] : NULL;
+}
+
+// Write back the run of dirty cached pages starting at first in one call, up to vram_io_pages and limit (at least 1).
+// A page that can be elided ends the run. Always cleans first, returns the number of pages cleaned.
+static VMUINT32 vram_write_run(VMUINT32 first, VMUINT32 limit) {
+	VMUINT32 n, count;
+	vram_slot_t *s;
+
+	for (n = 0; n < vram_io_pages && n < limit && first + n < vram_pages; n++) {
+		s = vram_dirty_slot(first + n);
+		if (s == NULL || (n && vram_write_elided(s->page, s->data)))
+			break;
+		if (!n && vram_write_elided(s->page, s->data)) {
+			vram_write_page(s); // Just cleans it
+			return 1;
+		}
+		memcpy(vram_io + (n << VRAM_PAGE_SHIFT), s->data, VRAM_PAGE_SIZE);
+	}
+	if (n < 2) {
+		vram_write_page(vram_dirty_slot(first));
+		return 1;
+	}
+
+	vram_store_write(first << VRAM_PAGE_SHIFT, vram_io, n << VRAM_PAGE_SHIFT);
+	for (count = n; n--; ) {
+		s = vram_dirty_slot(first + n);
+		vram_snap_dirty[s->page >> 5] |= 1u << (s->page & 31);
+		vram_lazy_drop(s->page);
+		s->dirty = 0;
+	}
+	return count;
+}
+
+// Write back up to max dirty cached pages, runs of neighbouring guest pages in one call each.
+// Called when the guest is idle so evictions find clean slots. Returns the number of pages written.
+VMUINT32 vram_writeback(VMUINT32 max) {
+	VMUINT32 first, done = 0;
+	vram_slot_t *s;
+	int i;
+
+	for (i = 0; i < vram_slot_count && done < max; i++) {
+		s = &vram_slots[i];
+		while (s->used && s->dirty && done < max) {
+			// Back to the start of the run, as long as s still fits in it
+			for (first = s->page; first > 0 && s->page - first + 1 < vram_io_pages && vram_dirty_slot(first - 1); first--)
+				;
+			done += vram_write_run(first, max - done);
+		}
+	}
+	return done;
+}
+
+// Write all dirty pages back to the RAM file
+void vram_flush(void) {
+	vram_writeback(vram_pages);
+
+	if (vram_res_dirty) {
+		vram_flush_resident(0, vram_res_lo >> VRAM_PAGE_SHIFT);
+		if (vram_res_hi != 0xFFFFFFFF)
+			vram_flush_resident(vram_res_hi >> VRAM_PAGE_SHIFT, vram_pages);
+	}
+}
+
+// The RAM file was rewritten behind the cache (snapshot restore): drop cached pages
+// without writing them back and read the resident regions again
+void vram_reload(void) {
+	int i;
+	for (i = 0; i < vram_slot_count; i++) {
+		if (vram_slots[i].used)
+			vram_map[vram_slots[i].page] = VRAM_NO_SLOT;
+		vram_slots[i].used = 0;
+		vram_slots[i].dirty = 0;
+	}
+
+	if (vram_res_dirty) {
+		memset(vram_res_dirty, 0, vram_pages);
+		vram_read_range(vram_image, 0, vram_res_lo);
+		if (vram_res_hi != 0xFFFFFFFF)
+			vram_read_range(vram_image_hi, vram_res_hi, (vram_pages << VRAM_PAGE_SHIFT) - vram_res_hi);
+	}
+}
+
+// Read the header of a boot image built by tools/mkimg. Returns 0 for anything else, such as a raw RAM image.
+int vram_img_probe(VMFILE f, vram_img_t *img) {
+	VMUINT size = 0, pages;
+
+	vm_file_getfilesize(f, &size);
+	vram_file_read(f, 0, (VMUINT8*)img, sizeof(*img));
+	if (img->magic != VRAM_IMG_MAGIC || img->version != VRAM_IMG_VERSION || img->page_shift != VRAM_PAGE_SHIFT ||
+		img->ram_size == 0 || (img->ram_size & VRAM_PAGE_MASK))
+		return 0;
+	pages = img->ram_size >> VRAM_PAGE_SHIFT;
+	return pages <= VRAM_IMG_MAX_PAGES && img->slots <= pages && img->dtb_size <= img->ram_size &&
+		img->dtb_ofs <= img->ram_size - img->dtb_size && size >= VRAM_IMG_DATA(pages) + (img->slots << VRAM_PAGE_SHIFT);
+}
+
+// Overlay mode: base stays read only and the RAM file passed to vram_init() only holds
+// the pages written so far, see vram.h. The base is a raw RAM image or a boot image.
+// Takes over the base file handle. Call before vram_init_resident().
+// Returns 0 if the indexes don't fit in the heap.
+int vram_overlay_begin(VMFILE base) {
+	VMUINT32 hdr[3], i;
+	VMUINT size = 0, r = 0, w;
+	VMUINT32 index_len = vram_pages * sizeof(VMUINT16);
+	vram_img_t img;
+	int boot = vram_img_probe(base, &img);
+
+	vram_cow = (VMUINT16*)vm_calloc(index_len);
+	if (boot)
+		vram_base_index = (VMUINT16*)vm_calloc(index_len);
+	if (vram_cow == NULL || (boot && vram_base_index == NULL)) {
+		if (vram_cow)
+			vm_free(vram_cow);
+		if (vram_base_index)
+			vm_free(vram_base_index);
+		vram_cow = NULL;
+		vram_base_index = NULL;
+		vm_file_close(base);
+		return 0;
+	}
+	if (boot) { // Guest RAM past the image's own size reads as zero
+		i = img.ram_size >> VRAM_PAGE_SHIFT;
+		vram_file_read(base, VRAM_IMG_INDEX, (VMUINT8*)vram_base_index, (i < vram_pages ? i : vram_pages) * sizeof(VMUINT16));
+		vram_base_data = VRAM_IMG_DATA(i);
+	}
+	vram_cow_data = (VRAM_COW_INDEX + index_len + VRAM_PAGE_MASK) & ~VRAM_PAGE_MASK;
+	vram_cow_slots = 0;
+
+	vm_file_getfilesize(vram_file, &size);
+	vm_file_seek_opt(vram_file, 0, BASE_BEGIN);
+	vm_file_read_opt(vram_file, hdr, sizeof(hdr), &r);
+	if (size >= vram_cow_data && r == sizeof(hdr) && hdr[0] == VRAM_COW_MAGIC &&
+		hdr[1] == VRAM_PAGE_SHIFT && hdr[2] == vram_pages) {
+		vram_file_read(vram_file, VRAM_COW_INDEX, (VMUINT8*)vram_cow, index_len);
+		for (i = 0; i < vram_pages; i++)
+			if (vram_cow[i] > vram_cow_slots)
+				vram_cow_slots = vram_cow[i];
+	} else {
+		// New or unusable overlay, start over with every page from the base
+		hdr[0] = VRAM_COW_MAGIC;
+		hdr[1] = VRAM_PAGE_SHIFT;
+		hdr[2] = vram_pages;
+		vm_file_seek_opt(vram_file, 0, BASE_BEGIN);
+		vm_file_write_opt(vram_file, hdr, sizeof(hdr), &w);
+		vm_file_seek_opt(vram_file, VRAM_COW_INDEX, BASE_BEGIN);
+		vm_file_write_opt(vram_file, vram_cow, index_len, &w);
+	}
+
+	vram_base = base;
+	vram_base_size = 0;
+	vm_file_getfilesize(base, &vram_base_size);
+	vram_zero_init();
+	return 1;
+}
+
+// Resume from a checkpoint without copying it: every page is read from image
+// (guest RAM at offset ofs) until it is first written back to the RAM file.
+// Takes over the image file handle. Call vram_reload() afterwards.
+int vram_lazy_begin(VMFILE image, VMUINT32 ofs) {
+	vram_lazy_end();
+
+	vram_lazy = (VMUINT32*)vm_malloc((vram_pages + 31) / 32 * sizeof(VMUINT32));
+	vram_lazy_buf = (VMUINT8*)vm_malloc(VRAM_PAGE_SIZE);
+	if (vram_lazy == NULL || vram_lazy_buf == NULL) {
+		vram_lazy_end();
+		return 0;
+	}
+	memset(vram_lazy, 0xff, (vram_pages + 31) / 32 * sizeof(VMUINT32));
+	vram_lazy_file = image;
+	vram_lazy_ofs = ofs;
+	vram_lazy_next = 0;
+	vram_lazy_count = vram_pages;
+	return 1;
+}
+
+// The page is in the RAM file now
+void vram_lazy_drop(VMUINT32 page) {
+	if (!vram_is_lazy(page))
+		return;
+	vram_lazy[page >> 5] &= ~(1u << (page & 31));
+	if (--vram_lazy_count == 0)
+		vram_lazy_end();
+}
+
+// Copy up to max pages still only in the image into the RAM file.
+// Any newer contents are still dirty in memory and will be written over them.
+void vram_lazy_fill(VMUINT32 max) {
+	while (vram_lazy_count && max--) {
+		while (!vram_is_lazy(vram_lazy_next))
+			if (++vram_lazy_next == vram_pages)
+				vram_lazy_next = 0;
+		vram_read_page(vram_lazy_buf, vram_lazy_next);
+		if (!vram_is_zero(vram_lazy_next) || !vram_page_zero(vram_lazy_buf)) // Same as the checkpoint, no need for vram_snap_dirty
+			vram_store_write(vram_lazy_next << VRAM_PAGE_SHIFT, vram_lazy_buf, VRAM_PAGE_SIZE);
+		vram_lazy_drop(vram_lazy_next);
+	}
+}
+
+// Stop reading from the image, whether or not every page made it into the RAM file
+void vram_lazy_end(void) {
+	if (vram_lazy_file >= 0)
+		vm_file_close(vram_lazy_file);
+	if (vram_lazy)
+		vm_free(vram_lazy);
+	if (vram_lazy_buf)
+		vm_free(vram_lazy_buf);
+	vram_lazy_file = -1;
+	vram_lazy = NULL;
+	vram_lazy_buf = NULL;
+	vram_lazy_count = 0;
+}
+
+// Start a new snapshot interval
+void vram_snap_clear(void) {
+	memset(vram_snap_dirty, 0, (vram_pages + 31) / 32 * sizeof(VMUINT32));
+}
+
+// Free a slot with the CLOCK algorithm. Clean slots go first, but only within VRAM_EVICT_SKIP
+// steps of the hand: dirty pages pinned for longer starve the code pages. See vram_writeback().
+static vram_slot_t *vram_evict(void) {
+	vram_slot_t *s;
+	int steps;
+
+	for (steps = 0;; steps++) {
+		s = &vram_slots[vram_hand];
+		if (++vram_hand == vram_slot_count)
+			vram_hand = 0;
+		if (!s->used)
+			break;
+		if (s->ref) {
+			s->ref = 0; // Second chance
+			continue;
+		}
+		if (!s->dirty || steps >= VRAM_EVICT_SKIP || steps >= vram_slot_count / 16)
+			break;
+	}
+
+	if (s->used) {
+		if (s->dirty)
+			vram_write_page(s);
+		vram_map[s->page] = VRAM_NO_SLOT;
+		s->used = 0;
+	}
+	return s;
+}
+
+// Same for a readahead page, but only a free or clean slot before the hand gets back to stop,
+// so it neither writes nor takes a slot filled by the same miss. NULL if there is none.
+static vram_slot_t *vram_evict_clean(int stop) {
+	vram_slot_t *s;
+
+	while (vram_hand != stop) {
+		s = &vram_slots[vram_hand];
+		if (++vram_hand == vram_slot_count)
+			vram_hand = 0;
+		if (!s->used)
+			return s;
+		if (s->ref) {
+			s->ref = 0;
+			continue;
+		}
+		if (!s->dirty) {
+			vram_map[s->page] = VRAM_NO_SLOT;
+			s->used = 0;
+			return s;
+		}
+	}
+	return NULL;
+}
+
+static void vram_fill_slot(vram_slot_t *s, VMUINT32 page, VMUINT8 ref) {
+	s->page = page;
+	s->used = 1;
+	s->dirty = 0;
+	s->ref = ref;
+	vram_map[page] = (VMINT16)(s - vram_slots);
+}
+
+// Pages to read for a miss on page. Misses on consecutive pages double the window
+// up to vram_io_pages. It stops before cached and resident pages.
+static VMUINT32 vram_readahead(VMUINT32 page) {
+	VMUINT32 n, end = vram_res_hi != 0xFFFFFFFF ? vram_res_hi >> VRAM_PAGE_SHIFT : vram_pages;
+
+	if (page != vram_ra_next)
+		vram_ra_window = 0;
+	else if (vram_ra_window < vram_io_pages)
+		vram_ra_window = vram_ra_window ? vram_ra_window * 2 : 2;
+	if (vram_ra_window > vram_io_pages)
+		vram_ra_window = vram_io_pages;
+
+	for (n = 1; n < vram_ra_window && page + n < end && vram_map[page + n] == VRAM_NO_SLOT; n++)
+		;
+	vram_ra_next = page + n;
+	return n;
+}
+
+// Cache miss: evict a slot and read the page into it, with the pages after it if the misses are sequential
+vram_slot_t *vram_fault(VMUINT32 page) {
+	vram_slot_t *s, *first;
+	VMUINT32 i, n = vram_readahead(page);
+
+	PERF_INC(perf.faults);
+	if (n < 2) {
+		s = vram_evict();
+		vram_read_page(s->data, page);
+		vram_fill_slot(s, page, 1);
+		return s;
+	}
+
+	// One read for the window, then into slots. Readahead pages aren't referenced yet, so unused ones go first.
+	vram_read_range(vram_io, page << VRAM_PAGE_SHIFT, n << VRAM_PAGE_SHIFT);
+	first = vram_evict();
+	memcpy(first->data, vram_io, VRAM_PAGE_SIZE);
+	vram_fill_slot(first, page, 1);
+	for (i = 1; i < n; i++) {
+		s = vram_evict_clean((int)(first - vram_slots));
+		if (s == NULL)
+			break; // The rest is read again when it's needed
+		memcpy(s->data, vram_io + (i << VRAM_PAGE_SHIFT), VRAM_PAGE_SIZE);
+		vram_fill_slot(s, page + i, 0);
+	}
+	vram_ra_next = page + i;
+	return first;
+}
@@ -0,0 +1,251 @@
+#pragma once
+#include "vmsys.h"
+#include "vmio.h"
+
+/*
+ * Virtual RAM backing store.
+ * Guest RAM lives in a file on the memory card (see VRAM_FILE in main.c).
+ * A fixed pool of heap pages caches it, so loads and stores that hit the
+ * cache never touch the file API. Misses and write-backs move whole pages.
+ * Misses on consecutive pages read a growing window ahead in one call, and
+ * dirty pages are written back in runs of neighbours from vram_writeback()
+ * while the guest idles, so eviction rarely has to write.
+ *
+ * In overlay mode the image is a read-only base file and the RAM file only
+ * holds pages the guest has written: a header, a page index and the pages
+ * in the order they were first written:
+ *
+ *   +0                 VRAM_COW_MAGIC, VRAM_PAGE_SHIFT, guest RAM size in pages
+ *   +VRAM_COW_INDEX    VMUINT16 per guest page, slot + 1, 0 if never written
+ *   +page aligned      slots
+ *
+ * Pages never written read from the base, or as zero past its end without
+ * any I/O. Deleting the RAM file resets the guest to the base image.
+ *
+ * The base can also be a boot image built by tools/mkimg, which stores only
+ * the pages that aren't all zero, in page order:
+ *
+ *   +0                 vram_img_t: guest RAM size, where the DTB is
+ *   +VRAM_IMG_INDEX    VMUINT16 per guest page, slot + 1, 0 if all zero
+ *   +VRAM_IMG_DATA     slots
+ *
+ * Either way, pages known to be all zero in the backing store (past the end
+ * of a short RAM file, or read back as zeros once) are kept in a bitmap.
+ * Faulting them in is a memset, and writing back a page that is still all
+ * zero is skipped, so BSS and freshly allocated guest memory cost no I/O
+ * until a non-zero value lands. A truncated or empty RAM file is fine.
+ *
+ * Optionally, the bottom (kernel text) and the top (DTB, early stack) of
+ * guest RAM are kept resident in one heap block sized from the free heap at
+ * startup. Accesses there are plain pointer dereferences.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef VRAM_PAGE_SHIFT
+#define VRAM_PAGE_SHIFT 12                    // Cache page size is 1 << VRAM_PAGE_SHIFT bytes (4 KiB)
+#endif
+#define VRAM_PAGE_SIZE (1 << VRAM_PAGE_SHIFT)
+#define VRAM_PAGE_MASK (VRAM_PAGE_SIZE - 1)
+
+#ifndef VRAM_PAGE_COUNT
+#define VRAM_PAGE_COUNT 128                   // Number of cached pages (512 KiB of heap with 4 KiB pages)
+#endif
+#define VRAM_MIN_PAGE_COUNT 8                 // Give up if the heap can't hold at least this many
+
+#ifndef VRAM_IO_PAGES
+#define VRAM_IO_PAGES 8                       // Most pages moved per file call by readahead and write-back
+#endif
+#ifndef VRAM_EVICT_SKIP
+#define VRAM_EVICT_SKIP 8                     // Slots the CLOCK hand may pass over looking for a clean victim, and no more than 1/16 of the cache
+#endif
+
+#define VRAM_NO_SLOT -1
+
+#define VRAM_COW_MAGIC 0x574f4356             // "VCOW"
+#define VRAM_COW_INDEX 16                     // Offset of the overlay page index
+
+#define VRAM_IMG_MAGIC 0x4956524d             // "MRVI"
+#define VRAM_IMG_VERSION 1
+#define VRAM_IMG_INDEX 32                     // Offset of the boot image page index
+#define VRAM_IMG_DATA(pages) ((VRAM_IMG_INDEX + (pages) * 2 + VRAM_PAGE_MASK) & ~VRAM_PAGE_MASK) // Offset of slot 0
+#define VRAM_IMG_MAX_PAGES 0xffff             // Slot numbers are VMUINT16
+
+#ifndef VRAM_HEAP_RESERVE
+#define VRAM_HEAP_RESERVE (256 * 1024)        // Heap left free for MRE, layers and the terminal when sizing resident RAM
+#endif
+#define VRAM_MIN_RESIDENT (16 * VRAM_PAGE_SIZE) // Not worth it below this
+
+// Optimized file APIs, resolved with vm_get_sym_entry in vm_main()
+typedef VMINT (*vm_file_seek_t)(VMFILE handle, VMINT offset, VMINT base);
+typedef VMINT (*vm_file_read_t)(VMFILE handle, void* data, VMUINT length, VMUINT* nread);
+typedef VMINT (*vm_file_write_t)(VMFILE handle, void* data, VMUINT length, VMUINT* written);
+
+extern vm_file_seek_t vm_file_seek_opt;
+extern vm_file_read_t vm_file_read_opt;
+extern vm_file_write_t vm_file_write_opt;
+
+typedef struct {
+	VMUINT8 *data;                            // VRAM_PAGE_SIZE bytes of cached guest memory
+	VMUINT32 page;                            // Guest page held by this slot
+	VMUINT8 used;
+	VMUINT8 dirty;                            // Must be written back before eviction
+	VMUINT8 ref;                              // CLOCK reference bit
+} vram_slot_t;
+
+extern VMINT16 *vram_map;                     // Guest page -> cache slot, VRAM_NO_SLOT if not cached
+extern vram_slot_t *vram_slots;
+extern int vram_slot_count;
+
+extern VMUINT8 *vram_image;                   // Resident low part of guest RAM, indexed by guest offset
+extern VMUINT8 *vram_image_hi;                // Resident high part, starts at guest offset vram_res_hi
+extern VMUINT32 vram_res_lo;                  // Guest offsets below this are resident
+extern VMUINT32 vram_res_hi;                  // Guest offsets from this one up are resident
+extern VMUINT8 *vram_res_dirty;               // Per guest page, set by stores to resident pages
+
+// Boot image header, little endian
+typedef struct {
+	VMUINT32 magic;                           // VRAM_IMG_MAGIC
+	VMUINT32 version;                         // VRAM_IMG_VERSION
+	VMUINT32 page_shift;                      // VRAM_PAGE_SHIFT it was built for
+	VMUINT32 ram_size;                        // Guest RAM size in bytes, whole pages
+	VMUINT32 slots;                           // Pages stored
+	VMUINT32 dtb_ofs;                         // Guest RAM offset of the DTB
+	VMUINT32 dtb_size;                        // Its totalsize
+	VMUINT32 reserved;
+} vram_img_t;
+
+extern VMUINT32 vram_pages;                   // Guest RAM size in pages
+extern VMUINT32 *vram_snap_dirty;             // Per guest page bit, set when the page is written to the RAM file, see snap.h
+extern VMUINT32 vram_lazy_count;              // Pages still read from a checkpoint image, see vram_lazy_begin()
+
+int vram_init(VMFILE file, VMUINT32 size, int page_count);
+int vram_overlay_begin(VMFILE base);
+int vram_img_probe(VMFILE f, vram_img_t *img);
+VMUINT32 vram_init_resident(VMUINT32 max, VMUINT32 high);
+void vram_deinit(void);
+void vram_flush(void);
+VMUINT32 vram_writeback(VMUINT32 max);
+void vram_reload(void);
+void vram_store_read(VMUINT32 ofs, VMUINT8 *data, VMUINT32 len);
+int vram_store_write(VMUINT32 ofs, const VMUINT8 *data, VMUINT32 len);
+void vram_snap_clear(void);
+
+int vram_lazy_begin(VMFILE image, VMUINT32 ofs);
+void vram_lazy_drop(VMUINT32 page);
+void vram_lazy_fill(VMUINT32 max);
+void vram_lazy_end(void);
+
+vram_slot_t *vram_fault(VMUINT32 page);
+
+// Get a pointer to guest RAM at ofs, valid up to the end of its page
+static inline VMUINT8 *vram_ptr(VMUINT32 ofs) {
+	if (ofs < vram_res_lo)
+		return vram_image + ofs;
+	if (ofs >= vram_res_hi)
+		return vram_image_hi + (ofs - vram_res_hi);
+
+	VMINT16 i = vram_map[ofs >> VRAM_PAGE_SHIFT];
+	vram_slot_t *s = (i != VRAM_NO_SLOT) ? &vram_slots[i] : vram_fault(ofs >> VRAM_PAGE_SHIFT);
+	s->ref = 1;
+	return s->data + (ofs & VRAM_PAGE_MASK);
+}
+
+// Bytes from ofs on that vram_ptr(ofs) gives in one piece: the rest of a resident region, or of the page
+static inline VMUINT32 vram_span(VMUINT32 ofs) {
+	if (ofs < vram_res_lo)
+		return vram_res_lo - ofs;
+	if (ofs >= vram_res_hi)
+		return (vram_pages << VRAM_PAGE_SHIFT) - ofs;
+	return VRAM_PAGE_SIZE - (ofs & VRAM_PAGE_MASK);
+}
+
+// Same as vram_ptr, but marks the page dirty
+static inline VMUINT8 *vram_ptr_w(VMUINT32 ofs) {
+	if (ofs < vram_res_lo) {
+		vram_res_dirty[ofs >> VRAM_PAGE_SHIFT] = 1;
+		return vram_image + ofs;
+	}
+	if (ofs >= vram_res_hi) {
+		vram_res_dirty[ofs >> VRAM_PAGE_SHIFT] = 1;
+		return vram_image_hi + (ofs - vram_res_hi);
+	}
+
+	VMINT16 i = vram_map[ofs >> VRAM_PAGE_SHIFT];
+	vram_slot_t *s = (i != VRAM_NO_SLOT) ? &vram_slots[i] : vram_fault(ofs >> VRAM_PAGE_SHIFT);
+	s->ref = 1;
+	s->dirty = 1;
+	return s->data + (ofs & VRAM_PAGE_MASK);
+}
+
+// Misaligned accesses go byte by byte, ARM7 can't do them natively. Within a page
+// that's one lookup, only one that crosses into the next page looks up both.
+#define VRAM_CROSSES(ofs, len) (((ofs) & VRAM_PAGE_MASK) > VRAM_PAGE_SIZE - (len))
+
+static inline VMUINT8 vram_load1(VMUINT32 ofs) {
+	return *vram_ptr(ofs);
+}
+
+static inline VMUINT16 vram_load2(VMUINT32 ofs) {
+	VMUINT8 *p;
+	if (!(ofs & 1))
+		return *(VMUINT16*)vram_ptr(ofs);
+	if (VRAM_CROSSES(ofs, 2))
+		return vram_load1(ofs) | (vram_load1(ofs + 1) << 8);
+	p = vram_ptr(ofs);
+	return p[0] | (p[1] << 8);
+}
+
+static inline VMUINT32 vram_load4(VMUINT32 ofs) {
+	VMUINT8 *p;
+	if (!(ofs & 3))
+		return *(VMUINT32*)vram_ptr(ofs);
+	if (VRAM_CROSSES(ofs, 4))
+		return vram_load2(ofs) | ((VMUINT32)vram_load2(ofs + 2) << 16);
+	p = vram_ptr(ofs);
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((VMUINT32)p[3] << 24);
+}
+
+static inline void vram_store1(VMUINT32 ofs, VMUINT8 val) {
+	*vram_ptr_w(ofs) = val;
+}
+
+static inline void vram_store2(VMUINT32 ofs, VMUINT16 val) {
+	VMUINT8 *p;
+	if (!(ofs & 1)) {
+		*(VMUINT16*)vram_ptr_w(ofs) = val;
+		return;
+	}
+	if (VRAM_CROSSES(ofs, 2)) {
+		vram_store1(ofs, val);
+		vram_store1(ofs + 1, val >> 8);
+		return;
+	}
+	p = vram_ptr_w(ofs);
+	p[0] = val;
+	p[1] = val >> 8;
+}
+
+static inline void vram_store4(VMUINT32 ofs, VMUINT32 val) {
+	VMUINT8 *p;
+	if (!(ofs & 3)) {
+		*(VMUINT32*)vram_ptr_w(ofs) = val;
+		return;
+	}
+	if (VRAM_CROSSES(ofs, 4)) {
+		vram_store2(ofs, val);
+		vram_store2(ofs + 2, val >> 16);
+		return;
+	}
+	p = vram_ptr_w(ofs);
+	p[0] = val;
+	p[1] = val >> 8;
+	p[2] = val >> 16;
+	p[3] = val >> 24;
+}
+
+#ifdef __cplusplus
+}
+#endif